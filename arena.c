@@ -0,0 +1,165 @@
+/*
+ * arena.c | Region allocation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "stats.h"
+
+/* Every allocation is aligned for anything */
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* Where a block's memory starts, past its header */
+#define BLOCK_DATA(block) \
+  ((char *) (block) + ARENA_ROUND(sizeof(struct ArenaBlock)))
+
+struct Arena *new_arena()
+{
+  struct Arena *arena = (struct Arena *) malloc( sizeof(struct Arena) );
+
+  arena->blocks = NULL;
+  arena->bytes_used = 0;
+  arena->bytes_reserved = 0;
+  arena->num_allocations = 0;
+
+  return arena;
+}
+
+void delete_arena(struct Arena *arena)
+{
+  struct ArenaBlock *block = arena->blocks;
+
+  while(block != NULL)
+  {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(arena);
+}
+
+void *arena_alloc(struct Arena *arena, size_t size)
+{
+  if(arena == NULL)
+    return malloc(size);
+
+  struct ArenaBlock *block = arena->blocks;
+
+  size = ARENA_ROUND(size);
+
+  if(block == NULL || block->used + size > block->size)
+  {
+    size_t data_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    size_t total = ARENA_ROUND(sizeof(struct ArenaBlock)) + data_size;
+
+    block = (struct ArenaBlock *) malloc( total );
+    block->size = data_size;
+    block->used = 0;
+
+    arena->bytes_reserved += total;
+
+    /* An oversized allocation gets a block to itself. Put it behind the one
+     *  being carved up, so what's left of that doesn't go to waste.
+     */
+    if(data_size > ARENA_BLOCK_SIZE && arena->blocks != NULL)
+    {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    }
+    else
+    {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+  }
+
+  void *pointer = BLOCK_DATA(block) + block->used;
+
+  block->used += size;
+  arena->bytes_used += size;
+  arena->num_allocations++;
+
+  return pointer;
+}
+
+void *arena_calloc(struct Arena *arena, size_t count, size_t size)
+{
+  if(arena == NULL)
+    return calloc(count, size);
+
+  void *pointer = arena_alloc(arena, count * size);
+  memset(pointer, 0, count * size);
+
+  return pointer;
+}
+
+char *arena_strdup(struct Arena *arena, const char *string)
+{
+  size_t length = strlen(string) + 1;
+  char *copy = (char *) arena_alloc(arena, length);
+
+  memcpy(copy, string, length);
+
+  return copy;
+}
+
+void arena_free(struct Arena *arena, void *pointer)
+{
+  if(arena == NULL)
+    free(pointer);
+}
+
+void *arena_grow(struct Arena *arena, void *array, int count, size_t size)
+{
+  if(arena == NULL)
+  {
+    STATS_COUNT(reallocs);
+    return realloc(array, (count + 1) * size);
+  }
+
+  /* Full exactly when count is a power of two (or nothing's there yet) */
+  if(count == 0)
+    return arena_alloc(arena, size);
+
+  if(count & (count - 1))
+    return array;
+
+  STATS_COUNT(reallocs);
+
+  void *grown = arena_alloc(arena, 2 * count * size);
+  memcpy(grown, array, count * size);
+
+  return grown;
+}
+
+void arena_adopt(struct Arena *into, struct Arena *from)
+{
+  /* Splice from's blocks in behind the one into is carving up */
+  if(from->blocks != NULL)
+  {
+    struct ArenaBlock *last = from->blocks;
+
+    while(last->next != NULL)
+      last = last->next;
+
+    if(into->blocks == NULL)
+      into->blocks = from->blocks;
+    else
+    {
+      last->next = into->blocks->next;
+      into->blocks->next = from->blocks;
+    }
+  }
+
+  into->bytes_used += from->bytes_used;
+  into->bytes_reserved += from->bytes_reserved;
+  into->num_allocations += from->num_allocations;
+
+  free(from);
+}
@@ -0,0 +1,59 @@
+/* Headers for arenas: memory handed out in bulk and given back all at once
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/* How much an arena asks malloc() for at a time, unless it's asked for more */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock
+{
+  struct ArenaBlock *next;
+  size_t size;
+  size_t used;
+};
+
+/*
+ * Everything allocated from an arena lives until the whole arena is deleted;
+ *  there is no freeing one piece of it. That makes allocating a bump of a
+ *  pointer, and throwing away an automaton one free() per block instead of
+ *  one per state, transition and array.
+ *
+ * Anywhere an arena is taken, NULL means the ordinary heap instead, so
+ *  arena_alloc() is malloc(), arena_free() is free() and so on.
+ */
+struct Arena
+{
+  struct ArenaBlock *blocks;    /* The one being carved up comes first */
+
+  size_t bytes_used;            /* Handed out, counting alignment padding */
+  size_t bytes_reserved;        /* Got from malloc(), block headers and all */
+  long num_allocations;
+};
+
+struct Arena *new_arena();
+void delete_arena(struct Arena *arena);
+
+void *arena_alloc(struct Arena *arena, size_t size);
+void *arena_calloc(struct Arena *arena, size_t count, size_t size);
+char *arena_strdup(struct Arena *arena, const char *string);
+
+/* Only actually frees anything for the heap */
+void arena_free(struct Arena *arena, void *pointer);
+
+/* Make room in an array of count elements for one more.
+ * The room is doubled whenever count is a power of two, so arrays must only
+ *  ever grow through here, starting from count 0, and shrinking them is just
+ *  lowering count. On the heap this is a plain realloc() to count + 1.
+ */
+void *arena_grow(struct Arena *arena, void *array, int count, size_t size);
+
+/* Move everything from one arena into another and delete it. Whatever was
+ *  allocated from it now lives as long as into does.
+ */
+void arena_adopt(struct Arena *into, struct Arena *from);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * batch.c | Running a batch of jobs on a pool of threads, in order
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "batch.h"
+
+struct Batch
+{
+  void **items;
+  int num_items;
+  batch_job job;
+
+  /* The next item nobody has started on */
+  atomic_int next_item;
+
+  /* What each finished job wrote, until it's that job's turn to go out */
+  char **output;
+  size_t *output_size;
+  char *done;
+  int next_to_write;
+
+  pthread_mutex_t lock;
+  FILE *out;
+};
+
+static void *batch_worker(void *arg);
+
+void run_batch(void **items, int num_items, batch_job job, int num_threads,
+    FILE *out)
+{
+  struct Batch batch;
+  int i;
+
+  batch.items = items;
+  batch.num_items = num_items;
+  batch.job = job;
+  atomic_init(&batch.next_item, 0);
+  batch.output = (char **) calloc( num_items, sizeof(char *) );
+  batch.output_size = (size_t *) calloc( num_items, sizeof(size_t) );
+  batch.done = (char *) calloc( num_items, 1 );
+  batch.next_to_write = 0;
+  batch.out = out;
+  pthread_mutex_init(&batch.lock, NULL);
+
+  if(num_threads > num_items)
+    num_threads = num_items;
+
+  if(num_threads <= 1)
+    batch_worker(&batch);
+  else
+  {
+    pthread_t *threads = (pthread_t *)
+      malloc( num_threads * sizeof(pthread_t) );
+
+    for(i = 0; i < num_threads; i++)
+      pthread_create(&threads[i], NULL, batch_worker, &batch);
+
+    for(i = 0; i < num_threads; i++)
+      pthread_join(threads[i], NULL);
+
+    free(threads);
+  }
+
+  pthread_mutex_destroy(&batch.lock);
+  free(batch.output);
+  free(batch.output_size);
+  free(batch.done);
+}
+
+static void *batch_worker(void *arg)
+{
+  struct Batch *batch = (struct Batch *) arg;
+  int i;
+
+  while((i = atomic_fetch_add(&batch->next_item, 1)) < batch->num_items)
+  {
+    char *text = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&text, &size);
+
+    batch->job(batch->items[i], i, stream);
+    fclose(stream);
+
+    pthread_mutex_lock(&batch->lock);
+
+    batch->output[i] = text;
+    batch->output_size[i] = size;
+    batch->done[i] = 1;
+
+    /* Write out whatever's next in line now, this one or not */
+    while(batch->next_to_write < batch->num_items &&
+        batch->done[batch->next_to_write])
+    {
+      int next = batch->next_to_write++;
+
+      fwrite(batch->output[next], 1, batch->output_size[next], batch->out);
+      free(batch->output[next]);
+      batch->output[next] = NULL;
+    }
+
+    pthread_mutex_unlock(&batch->lock);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,25 @@
+/* Headers for running a batch of jobs on a pool of threads
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+
+/* One job of a batch: do something with the item at index, writing anything
+ *  it has to say to out
+ */
+typedef void (*batch_job)(void *item, int index, FILE *out);
+
+/*
+ * Run a job for every item, on up to num_threads threads, each taking the
+ *  next item nobody has started on yet.
+ * Each job writes to a stream of its own, and those get written to out in
+ *  the order the items are in, however the jobs happen to finish: each as
+ *  soon as every one before it has.
+ * With a single thread, the jobs are just run one after another.
+ */
+void run_batch(void **items, int num_items, batch_job job, int num_threads,
+    FILE *out);
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ * bench.c | Timing every stage, from building NFAs to drawing them
+ *
+ * Each family of patterns is built at a few sizes. For each one, building
+ *  the NFA with the combinators, simplifying it, determinizing it,
+ *  minimizing that, drawing the DFA and matching with it are timed on their
+ *  own. The results go into bench_output.txt, a line for each stage, tab
+ *  separated, so that runs from different versions can be compared.
+ * Given -g, the NFAs are all Glushkov automata rather than Thompson's, to
+ *  compare the two.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fsm.h"
+#include "dot_output.h"
+#include "dfsm.h"
+#include "minimize.h"
+#include "dfa_table.h"
+#include "lazy_dfa.h"
+#include "stream.h"
+#include "simplify.h"
+#include "ranges.h"
+
+#define BENCH_OUTPUT "bench_output.txt"
+
+/* How much input each matcher gets, in lines of BENCH_LINE_LENGTH */
+#define BENCH_INPUT_SIZE (4 << 20)
+#define BENCH_LINE_LENGTH 80
+
+/* Building is quick, so it's done over and over for at least this long */
+#define BENCH_MIN_SECONDS 0.1
+
+typedef struct FSM *(*pattern_func)(struct Arena *arena, int n);
+typedef struct FSM *(*combine_func)(struct FSM *left, struct FSM *right);
+typedef struct FSM *(*closure_func)(struct FSM *left);
+
+struct Family
+{
+  const char *name;
+  pattern_func pattern;
+  const char *letters;    /* Which letters the matching input is made of */
+  int sizes[4];           /* Ending in 0 */
+};
+
+extern void *EPSILON;
+
+void **alphabet = NULL;
+int alphabet_size = 0;
+struct SymbolTable *symbol_table;
+
+/* How NFAs are put together: Thompson's construction unless given -g */
+static combine_func union_of = fsmunion;
+static combine_func cat = fsmcat;
+static closure_func closure = fsmclosure;
+
+static struct FSM *long_concatenation(struct Arena *arena, int n);
+static struct FSM *wide_alternation(struct Arena *arena, int n);
+static struct FSM *nested_stars(struct Arena *arena, int n);
+static struct FSM *exponential(struct Arena *arena, int n);
+static struct FSM *keywords(struct Arena *arena, int n);
+
+static struct Family families[] =
+{
+  { "concatenation", long_concatenation, "abcdefgh", { 100, 1000, 4000, 0 } },
+  { "alternation", wide_alternation, "abcdefghijklmnopqrstuvwxyz",
+    { 10, 100, 200, 0 } },
+  { "nested_stars", nested_stars, "abcdefghijklmnopqrstuvwxyz",
+    { 5, 20, 50, 0 } },
+  { "exponential", exponential, "ab", { 4, 8, 12, 0 } },
+  { "keywords", keywords, "abcdefghijklmnopqrstuvwxyz", { 8, 16, 32, 0 } },
+};
+
+static const char *c_keywords[] =
+{
+  "auto", "break", "case", "char", "const", "continue", "default", "do",
+  "double", "else", "enum", "extern", "float", "for", "goto", "if", "int",
+  "long", "register", "return", "short", "signed", "sizeof", "static",
+  "struct", "switch", "typedef", "union", "unsigned", "void", "volatile",
+  "while"
+};
+
+static unsigned long random_state = 1;
+
+static unsigned long next_random(void);
+static double now(void);
+static struct FSM *character(struct Arena *arena, char c);
+static struct FSM *word(struct Arena *arena, const char *letters);
+static struct FSM *any_of(struct Arena *arena, const char *letters);
+static void *bench_symbol(char c);
+static int symbol_bytes(void *value, int *low, int *high);
+static char *symbol_string(void *value);
+static char *id_string(void *id);
+static char *make_input(const char *letters, size_t size);
+static void report(FILE *out, struct Family *family, int n,
+    const char *phase, double seconds, int states, double mb_per_s);
+static void bench(FILE *out, struct Family *family, int n,
+    const char *input, size_t input_size);
+
+int main(int argc, char **argv)
+{
+  int i, j;
+
+  if(argc > 1 && strcmp(argv[1], "-g") == 0)
+  {
+    union_of = glushkov_union;
+    cat = glushkov_cat;
+    closure = glushkov_closure;
+  }
+  else if(argc > 1)
+  {
+    fprintf(stderr, "usage: %s [-g]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *out = fopen(BENCH_OUTPUT, "w");
+
+  if(out == NULL)
+  {
+    perror(BENCH_OUTPUT);
+    return 1;
+  }
+
+  symbol_table = new_symbol_table();
+
+  fprintf(out, "family\tsize\tphase\tseconds\tstates\tmb_per_s\n");
+
+  for(i = 0; i < (int) (sizeof(families) / sizeof(families[0])); i++)
+  {
+    char *input = make_input(families[i].letters, BENCH_INPUT_SIZE);
+
+    for(j = 0; families[i].sizes[j] != 0; j++)
+      bench(out, &families[i], families[i].sizes[j], input,
+          BENCH_INPUT_SIZE);
+
+    free(input);
+  }
+
+  fclose(out);
+  delete_symbol_table(symbol_table);
+
+  printf("Results are in %s\n", BENCH_OUTPUT);
+
+  return 0;
+}
+
+static void bench(FILE *out, struct Family *family, int n,
+    const char *input, size_t input_size)
+{
+  struct Arena *arena = NULL;
+  struct FSM *nfa;
+  double start, seconds;
+  int runs = 0;
+
+  /* Thompson's construction, as many times as it takes to time it */
+  start = now();
+
+  do
+  {
+    if(arena != NULL)
+      delete_arena(arena);
+
+    arena = new_arena();
+    random_state = n;
+    nfa = family->pattern(arena, n);
+    runs++;
+  } while((seconds = now() - start) < BENCH_MIN_SECONDS);
+
+  report(out, family, n, "construct", seconds / runs, nfa->num_states, 0);
+
+  start = now();
+  simplify_fsm(nfa, NULL);
+  report(out, family, n, "simplify", now() - start, nfa->num_states, 0);
+
+  start = now();
+  struct FSM *dfa = deterministic_fsm(nfa, alphabet, alphabet_size);
+  report(out, family, n, "determinize", now() - start, dfa->num_states, 0);
+
+  start = now();
+  struct FSM *min = minimize_fsm(dfa);
+  report(out, family, n, "minimize", now() - start, min->num_states, 0);
+
+  /* Named the way regexp drawings are, which isn't part of drawing them */
+  int i;
+
+  for(i = 0; i < min->num_states; i++)
+  {
+    char *s = (char *) arena_alloc(arena, 16);
+    sprintf(s, "s%i", i);
+    min->states[i]->id = s;
+  }
+
+  FILE *null = fopen("/dev/null", "w");
+  start = now();
+  fprint_fsm(null, min, symbol_string, id_string);
+  report(out, family, n, "emit", now() - start, min->num_states, 0);
+  fclose(null);
+
+  /* A grep-style scan of lines for a match anywhere in them */
+  char path[] = "/tmp/bench.XXXXXX";
+  int fd = mkstemp(path);
+
+  if(fd >= 0 && write(fd, input, input_size) == (ssize_t) input_size)
+  {
+    struct MatchStream *stream = new_match_stream(nfa, alphabet,
+        alphabet_size, symbol_bytes, LAZY_DFA_DEFAULT_BUDGET, 1);
+    FILE *matches = fopen("/dev/null", "w");
+
+    start = now();
+    scan_file(stream, path, matches, NULL);
+    seconds = now() - start;
+
+    report(out, family, n, "match_stream", seconds,
+        stream->lazy->num_states, input_size / seconds / (1 << 20));
+
+    fclose(matches);
+    delete_match_stream(stream);
+  }
+
+  if(fd >= 0)
+  {
+    close(fd);
+    unlink(path);
+  }
+
+  /* The table for anything, then the pattern, so that it goes through every
+   *  byte of every line rather than giving up at the first mismatch
+   */
+  random_state = n;
+
+  struct FSM *search = cat(closure(any_of(arena, family->letters)),
+      family->pattern(arena, n));
+  struct DFATable *table = freeze_dfa(minimize_fsm(
+        deterministic_fsm(search, alphabet, alphabet_size)), symbol_bytes);
+
+  if(table != NULL)
+  {
+    const char *line = input, *end = input + input_size;
+    long matched = 0;
+
+    start = now();
+
+    while(line < end)
+    {
+      const char *newline = (const char *) memchr(line, '\n', end - line);
+
+      matched += dfa_table_match(table, line, newline - line);
+      line = newline + 1;
+    }
+
+    seconds = now() - start;
+
+    /* Only so that the loop can't be thrown away */
+    if(matched < 0)
+      printf("%ld\n", matched);
+
+    report(out, family, n, "match_table", seconds, table->num_states,
+        input_size / seconds / (1 << 20));
+
+    delete_dfa_table(table);
+  }
+
+  delete_arena(arena);
+}
+
+static void report(FILE *out, struct Family *family, int n,
+    const char *phase, double seconds, int states, double mb_per_s)
+{
+  fprintf(out, "%s\t%i\t%s\t%.6f\t%i\t%.1f\n", family->name, n, phase,
+      seconds, states, mb_per_s);
+
+  printf("%-14s %5i %-13s %10.6fs %8i states", family->name, n, phase,
+      seconds, states);
+
+  if(mb_per_s > 0)
+    printf(" %8.1f MB/s", mb_per_s);
+
+  printf("\n");
+  fflush(stdout);
+}
+
+/* n letters, going round the first eight of the alphabet */
+static struct FSM *long_concatenation(struct Arena *arena, int n)
+{
+  struct FSM *fsm = character(arena, 'a');
+  int i;
+
+  for(i = 1; i < n; i++)
+    fsm = cat(fsm, character(arena, 'a' + i % 8));
+
+  return fsm;
+}
+
+/* n random words of six letters, any of them */
+static struct FSM *wide_alternation(struct Arena *arena, int n)
+{
+  struct FSM *fsm = NULL;
+  char letters[7];
+  int i, j;
+
+  for(i = 0; i < n; i++)
+  {
+    for(j = 0; j < 6; j++)
+      letters[j] = 'a' + next_random() % 26;
+    letters[6] = '\0';
+
+    fsm = (fsm == NULL) ? word(arena, letters) :
+      union_of(fsm, word(arena, letters));
+  }
+
+  return fsm;
+}
+
+/* ((((a*b)*c)*d)* ... n deep */
+static struct FSM *nested_stars(struct Arena *arena, int n)
+{
+  struct FSM *fsm = character(arena, 'a');
+  int i;
+
+  for(i = 1; i <= n; i++)
+    fsm = closure(cat(closure(fsm),
+          character(arena, 'a' + i % 26)));
+
+  return fsm;
+}
+
+/* (a|b)*a(a|b)(a|b)... with n (a|b)s at the end, which takes a DFA of
+ *  2^(n+1) states
+ */
+static struct FSM *exponential(struct Arena *arena, int n)
+{
+  struct FSM *fsm = cat(closure(any_of(arena, "ab")),
+      character(arena, 'a'));
+  int i;
+
+  for(i = 0; i < n; i++)
+    fsm = cat(fsm, any_of(arena, "ab"));
+
+  return fsm;
+}
+
+/* The first n of C's keywords */
+static struct FSM *keywords(struct Arena *arena, int n)
+{
+  struct FSM *fsm = word(arena, c_keywords[0]);
+  int i;
+
+  for(i = 1; i < n && i < (int) (sizeof(c_keywords) / sizeof(char *)); i++)
+    fsm = union_of(fsm, word(arena, c_keywords[i]));
+
+  return fsm;
+}
+
+static struct FSM *character(struct Arena *arena, char c)
+{
+  struct FSM *fsm = new_fsm(arena);
+
+  add_state(fsm, new_state(arena, NULL));
+  add_state(fsm, new_state(arena, NULL));
+  fsm->start_state = fsm->states[0];
+  fsm->states[1]->accepting = 1;
+
+  add_transition(fsm->states[0], fsm->states[1], bench_symbol(c));
+
+  return fsm;
+}
+
+static struct FSM *word(struct Arena *arena, const char *letters)
+{
+  struct FSM *fsm = character(arena, letters[0]);
+
+  for(letters++; *letters; letters++)
+    fsm = cat(fsm, character(arena, *letters));
+
+  return fsm;
+}
+
+static struct FSM *any_of(struct Arena *arena, const char *letters)
+{
+  struct FSM *fsm = character(arena, letters[0]);
+
+  for(letters++; *letters; letters++)
+    fsm = union_of(fsm, character(arena, *letters));
+
+  return fsm;
+}
+
+static void *bench_symbol(char c)
+{
+  return intern_range(symbol_table, (unsigned char) c, (unsigned char) c,
+      &alphabet, &alphabet_size);
+}
+
+/* Lines of random letters */
+static char *make_input(const char *letters, size_t size)
+{
+  char *input = (char *) malloc( size );
+  size_t i, count = strlen(letters);
+
+  random_state = 12345;
+
+  for(i = 0; i < size; i++)
+    input[i] = (i % BENCH_LINE_LENGTH == BENCH_LINE_LENGTH - 1) ?
+      '\n' : letters[next_random() % count];
+
+  input[size - 1] = '\n';
+
+  return input;
+}
+
+/* Any old generator will do, as long as every run gets the same numbers */
+static unsigned long next_random(void)
+{
+  random_state = random_state * 6364136223846793005UL + 1442695040888963407UL;
+  return random_state >> 33;
+}
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int symbol_bytes(void *value, int *low, int *high)
+{
+  return parse_byte_range_name(symbol_name(symbol_table, value), low, high);
+}
+
+static char *symbol_string(void *value)
+{
+  return range_label(symbol_table, value);
+}
+
+static char *id_string(void *id)
+{
+  if(id == NULL)
+    return strdup("");
+  return strdup((char *) id);
+}
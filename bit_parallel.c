@@ -0,0 +1,168 @@
+/*
+ * bit_parallel.c | Bit-parallel simulation of the Glushkov automaton of an NFA
+ *
+ * The positions come straight out of the Thompson NFA: each symbol
+ *  transition is one, which in the packed NFA makes them its edges, in order.
+ *  A position j follows a position i if j's transition starts somewhere in
+ *  the epsilon closure of where i's transition ends.
+ */
+
+#include <stdlib.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "nfa_csr.h"
+#include "bit_parallel.h"
+
+extern void *EPSILON;
+
+static int count_transition_positions(struct Transition *root);
+static uint64_t follow_from(struct EpsilonClosures *closures, int state,
+    uint64_t *leaving, uint64_t *accepts);
+
+int count_positions(struct FSM *nfa)
+{
+  int i, count = 0;
+
+  for(i = 0; i < nfa->num_states; i++)
+    if(nfa->states[i]->transitions_tree != NULL)
+      count += count_transition_positions(nfa->states[i]->transitions_tree);
+
+  return count;
+}
+
+struct BitParallel *new_bit_parallel(struct FSM *nfa,
+    symbol_bytes_func symbol_bytes)
+{
+  int num_positions = count_positions(nfa), i, k, v, s;
+
+  if(num_positions > BIT_PARALLEL_MAX_POSITIONS)
+    return NULL;
+
+  struct CompiledNFA *csr = compile_nfa(nfa, NULL, 0);
+  int low[BIT_PARALLEL_MAX_POSITIONS], high[BIT_PARALLEL_MAX_POSITIONS];
+
+  for(i = 0; i < num_positions; i++)
+  {
+    if(!symbol_bytes(csr->symbols[csr->edges[i].symbol], &low[i],
+          &high[i]) || low[i] < 0 || high[i] > 255)
+    {
+      delete_compiled_nfa(csr);
+      return NULL;
+    }
+  }
+
+  struct BitParallel *bp = (struct BitParallel *)
+    calloc( 1, sizeof(struct BitParallel) );
+
+  bp->num_positions = num_positions;
+  bp->num_tables = (num_positions + 1 + 7) / 8;
+
+  /* Position i is bit i + 1 */
+  uint64_t *leaving = (uint64_t *) calloc( csr->num_states, sizeof(uint64_t) );
+  uint64_t follow[BIT_PARALLEL_MAX_POSITIONS + 1], accepts;
+
+  for(s = 0; s < csr->num_states; s++)
+    for(i = csr->edge_start[s]; i < csr->edge_start[s + 1]; i++)
+    {
+      leaving[s] |= 1ULL << (i + 1);
+
+      for(v = low[i]; v <= high[i]; v++)
+        bp->masks[v] |= 1ULL << (i + 1);
+    }
+
+  struct EpsilonClosures *closures = compute_epsilon_closures(csr);
+
+  /* The initial state is followed by whatever can be read first */
+  follow[0] = follow_from(closures, csr->start, leaving, &accepts);
+  if(accepts)
+    bp->final |= 1;
+
+  for(i = 0; i < num_positions; i++)
+  {
+    follow[i + 1] = follow_from(closures, csr->edges[i].target, leaving,
+        &accepts);
+    if(accepts)
+      bp->final |= 1ULL << (i + 1);
+  }
+
+  delete_epsilon_closures(closures);
+  delete_compiled_nfa(csr);
+  free(leaving);
+
+  /* Each table entry is the one without its lowest bit, plus that bit's */
+  for(k = 0; k < bp->num_tables; k++)
+    for(v = 1; v < 256; v++)
+    {
+      int bit = 8 * k + __builtin_ctz(v);
+
+      bp->follow[k][v] = bp->follow[k][v & (v - 1)];
+      if(bit <= num_positions)
+        bp->follow[k][v] |= follow[bit];
+    }
+
+  return bp;
+}
+
+void delete_bit_parallel(struct BitParallel *bp)
+{
+  free(bp);
+}
+
+int bit_parallel_match(struct BitParallel *bp, const char *input,
+    size_t length)
+{
+  const unsigned char *cur = (const unsigned char *) input;
+  const unsigned char *end = cur + length;
+  uint64_t current = 1;
+
+  while(cur < end)
+  {
+    current = bit_parallel_step(bp, current, *cur++);
+
+    if(!current)
+      return 0;
+  }
+
+  return (current & bp->final) != 0;
+}
+
+static int count_transition_positions(struct Transition *root)
+{
+  int count = (root->value == EPSILON) ? 0 : root->num_to;
+
+  if(root->left != NULL)
+    count += count_transition_positions(root->left);
+  if(root->right != NULL)
+    count += count_transition_positions(root->right);
+
+  return count;
+}
+
+/* Every position leaving the epsilon closure of a state, and whether the
+ *  closure accepts
+ */
+static uint64_t follow_from(struct EpsilonClosures *closures, int state,
+    uint64_t *leaving, uint64_t *accepts)
+{
+  struct StateArray *reach = new_state_array(closures);
+  uint64_t follow = 0;
+  int i;
+
+  reach->bits[state / STATE_ARRAY_BITS] |= 1UL << (state % STATE_ARRAY_BITS);
+  fill_state_array(closures, reach);
+  epsilon_closure(closures, reach);
+
+  *accepts = 0;
+
+  for(i = 0; i < reach->num_states; i++)
+  {
+    follow |= leaving[reach->states[i]->index];
+    if(compiled_accepting(closures->csr, reach->states[i]->index))
+      *accepts = 1;
+  }
+
+  delete_state_array(reach);
+
+  return follow;
+}
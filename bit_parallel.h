@@ -0,0 +1,61 @@
+/* Headers for the bit-parallel (Glushkov) NFA simulation
+ */
+
+#ifndef __BIT_PARALLEL_H__
+#define __BIT_PARALLEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bit 0 of a state word is the initial state, leaving room for this many
+ *  positions in a 64 bit word.
+ */
+#define BIT_PARALLEL_MAX_POSITIONS 63
+
+/*
+ * A position is one symbol transition of the NFA. Being "at" a position means
+ *  having just read its symbol. The set of positions we could be at fits in
+ *  one word, and moving it on a byte is
+ *
+ *   next = follow(current) & masks[byte]
+ *
+ * where follow() is looked up a byte of the current word at a time, out of
+ *  the follow tables: follow[k][v] is every position that can come straight
+ *  after any of the positions set in v << (8 * k).
+ */
+struct BitParallel
+{
+  uint64_t masks[256];      /* The positions whose symbol is each byte */
+  uint64_t follow[8][256];
+  uint64_t final;           /* Positions a match can end at */
+  int num_positions;
+  int num_tables;           /* How many of the follow tables are in use */
+};
+
+/* How many positions an NFA has */
+int count_positions(struct FSM *nfa);
+
+/* Returns NULL if the NFA has more than BIT_PARALLEL_MAX_POSITIONS
+ *  positions, or symbols that aren't bytes.
+ */
+struct BitParallel *new_bit_parallel(struct FSM *nfa,
+    symbol_bytes_func symbol_bytes);
+void delete_bit_parallel(struct BitParallel *bp);
+
+static inline uint64_t bit_parallel_step(struct BitParallel *bp,
+    uint64_t current, unsigned char byte)
+{
+  uint64_t next = 0;
+  int k;
+
+  for(k = 0; k < bp->num_tables; k++)
+    next |= bp->follow[k][(current >> (8 * k)) & 0xff];
+
+  return next & bp->masks[byte];
+}
+
+/* Does the NFA accept exactly this input? */
+int bit_parallel_match(struct BitParallel *bp, const char *input,
+    size_t length);
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * cache.c | An on-disk cache of compiled automata
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "fsm.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "RXC1"
+
+/* Where the entries go, inside the directory the cache was opened in. It's
+ *  made by the cache and only has its files in it, so nothing anybody else
+ *  keeps alongside gets counted, let alone deleted.
+ */
+#define CACHE_SUBDIRECTORY "regexp-cache"
+
+/* An entry's name is its hash in hex */
+#define CACHE_HASH_DIGITS 32
+
+/* Room for a slash, the hash in hex and a NUL */
+#define CACHE_NAME_LENGTH 34
+
+/* Where reading a file has got to */
+struct CacheReader
+{
+  const char *cur, *end;
+  int ok;
+};
+
+struct CacheEntry
+{
+  char name[CACHE_NAME_LENGTH];
+  time_t last_used;
+  size_t size;
+};
+
+static char *entry_path(struct CompileCache *cache, const char *key);
+static void write_u32(FILE *file, uint32_t value);
+static uint32_t read_u32(struct CacheReader *reader);
+static const char *read_bytes(struct CacheReader *reader, uint32_t length);
+static int count_transitions(struct Transition *root);
+static void write_transitions(FILE *file, struct Transition *root,
+    struct SymbolTable *symbols);
+static size_t measure_directory(struct CompileCache *cache,
+    struct CacheEntry **entries, int *num_entries);
+static void evict(struct CompileCache *cache);
+static int is_entry_name(const char *name);
+static int is_entry_file(const char *path);
+static int compare_last_used(const void *left, const void *right);
+
+struct CompileCache *open_compile_cache(const char *directory,
+    size_t max_bytes)
+{
+  struct stat info;
+  char *entries = (char *) malloc( strlen(directory) +
+      sizeof(CACHE_SUBDIRECTORY) + 1 );
+
+  sprintf(entries, "%s/%s", directory, CACHE_SUBDIRECTORY);
+
+  mkdir(directory, 0755);
+  mkdir(entries, 0755);
+
+  if(stat(entries, &info) != 0 || !S_ISDIR(info.st_mode) ||
+      access(entries, R_OK | W_OK | X_OK) != 0)
+  {
+    free(entries);
+    return NULL;
+  }
+
+  struct CompileCache *cache = (struct CompileCache *)
+    malloc( sizeof(struct CompileCache) );
+
+  cache->directory = entries;
+  cache->max_bytes = max_bytes;
+  cache->hits = cache->misses = 0;
+  pthread_mutex_init(&cache->lock, NULL);
+
+  cache->bytes_used = measure_directory(cache, NULL, NULL);
+
+  if(cache->bytes_used > cache->max_bytes)
+    evict(cache);
+
+  return cache;
+}
+
+void close_compile_cache(struct CompileCache *cache)
+{
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->directory);
+  free(cache);
+}
+
+struct FSM *compile_cache_load(struct CompileCache *cache, const char *key,
+    struct Arena *arena, struct SymbolTable *symbols)
+{
+  char *path = entry_path(cache, key);
+  FILE *file = fopen(path, "rb");
+  struct FSM *dfa = NULL;
+  char *buffer = NULL;
+  long size = 0;
+
+  if(file != NULL && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0)
+  {
+    buffer = (char *) malloc( size );
+    rewind(file);
+
+    if(fread(buffer, 1, size, file) != (size_t) size)
+      size = 0;
+  }
+
+  if(file != NULL)
+    fclose(file);
+
+  struct CacheReader reader = { buffer, buffer + size, size > 0 };
+  const char *magic = read_bytes(&reader, 4);
+  uint32_t key_length = read_u32(&reader);
+  const char *stored_key = read_bytes(&reader, key_length);
+
+  /* Make sure it's really this key's, and not some other that hashes the
+   *  same
+   */
+  if(reader.ok && memcmp(magic, CACHE_MAGIC, 4) == 0 &&
+      key_length == strlen(key) && memcmp(stored_key, key, key_length) == 0)
+  {
+    uint32_t num_states = read_u32(&reader);
+    uint32_t start = read_u32(&reader);
+    uint32_t i, j, k;
+
+    /* Every state takes up at least 12 bytes, which bounds how many there
+     *  can be before making any
+     */
+    if(reader.ok && start < num_states &&
+        num_states <= (size_t) (reader.end - reader.cur) / 12)
+    {
+      dfa = new_fsm(arena);
+
+      for(i = 0; i < num_states; i++)
+        add_state(dfa, new_state(arena, NULL));
+
+      dfa->start_state = dfa->states[start];
+
+      for(i = 0; reader.ok && i < num_states; i++)
+      {
+        struct State *state = dfa->states[i];
+
+        state->accepting = read_u32(&reader);
+
+        uint32_t num_patterns = read_u32(&reader);
+        const char *patterns = read_bytes(&reader,
+            num_patterns * sizeof(int));
+
+        if(reader.ok && num_patterns > 0)
+        {
+          int *copy = (int *) malloc( num_patterns * sizeof(int) );
+          memcpy(copy, patterns, num_patterns * sizeof(int));
+          set_patterns(state, copy, num_patterns);
+          free(copy);
+        }
+
+        uint32_t num_transitions = read_u32(&reader);
+
+        for(j = 0; reader.ok && j < num_transitions; j++)
+        {
+          uint32_t name_length = read_u32(&reader);
+          const char *name = read_bytes(&reader, name_length);
+          uint32_t num_to = read_u32(&reader);
+
+          if(!reader.ok)
+            break;
+
+          /* No name is EPSILON */
+          void *symbol = ID_SYMBOL(0);
+
+          if(name_length > 0)
+          {
+            char *copy = (char *) malloc( name_length + 1 );
+            memcpy(copy, name, name_length);
+            copy[name_length] = '\0';
+
+            symbol = intern_symbol(symbols, copy);
+            free(copy);
+          }
+
+          for(k = 0; reader.ok && k < num_to; k++)
+          {
+            uint32_t to = read_u32(&reader);
+
+            if(to >= num_states)
+              reader.ok = 0;
+            else
+              add_transition(state, dfa->states[to], symbol);
+          }
+        }
+      }
+
+      if(!reader.ok)
+      {
+        delete_fsm(dfa);
+        dfa = NULL;
+      }
+    }
+  }
+
+  /* Reading it counts as using it */
+  if(dfa != NULL)
+    utime(path, NULL);
+
+  pthread_mutex_lock(&cache->lock);
+  if(dfa != NULL)
+    cache->hits++;
+  else
+    cache->misses++;
+  pthread_mutex_unlock(&cache->lock);
+
+  free(buffer);
+  free(path);
+
+  return dfa;
+}
+
+int compile_cache_store(struct CompileCache *cache, const char *key,
+    struct FSM *dfa, struct SymbolTable *symbols)
+{
+  char *path = entry_path(cache, key);
+  char *temporary = (char *) malloc( strlen(cache->directory) + 16 );
+  int i, j;
+
+  /* Write it all under a name nobody will look for, then put it in place in
+   *  one go
+   */
+  sprintf(temporary, "%s/.tmp.XXXXXX", cache->directory);
+
+  int fd = mkstemp(temporary);
+  FILE *file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+
+  if(file == NULL)
+  {
+    if(fd >= 0)
+    {
+      close(fd);
+      unlink(temporary);
+    }
+
+    free(temporary);
+    free(path);
+    return 0;
+  }
+
+  fwrite(CACHE_MAGIC, 1, 4, file);
+  write_u32(file, strlen(key));
+  fwrite(key, 1, strlen(key), file);
+
+  write_u32(file, dfa->num_states);
+  write_u32(file, dfa->start_state->index);
+
+  for(i = 0; i < dfa->num_states; i++)
+  {
+    struct State *state = dfa->states[i];
+
+    write_u32(file, state->accepting);
+    write_u32(file, state->num_patterns);
+
+    for(j = 0; j < state->num_patterns; j++)
+      fwrite(&state->patterns[j], sizeof(int), 1, file);
+
+    if(state->transitions_tree == NULL)
+      write_u32(file, 0);
+    else
+    {
+      write_u32(file, count_transitions(state->transitions_tree));
+      write_transitions(file, state->transitions_tree, symbols);
+    }
+  }
+
+  int written = !ferror(file);
+  long size = ftell(file);
+
+  if(fclose(file) != 0)
+    written = 0;
+
+  struct stat old;
+  size_t replaced = (stat(path, &old) == 0) ? (size_t) old.st_size : 0;
+
+  if(!written || rename(temporary, path) != 0)
+  {
+    unlink(temporary);
+    written = 0;
+  }
+
+  if(written)
+  {
+    pthread_mutex_lock(&cache->lock);
+
+    cache->bytes_used += size - replaced;
+
+    if(cache->bytes_used > cache->max_bytes)
+      evict(cache);
+
+    pthread_mutex_unlock(&cache->lock);
+  }
+
+  free(temporary);
+  free(path);
+
+  return written;
+}
+
+/* The file for a key: a 128 bit hash of it (two different FNV-1a hashes),
+ *  in hex
+ */
+static char *entry_path(struct CompileCache *cache, const char *key)
+{
+  uint64_t first = 14695981039346656037UL, second = 0x6c62272e07bb0142UL;
+  const unsigned char *cur;
+
+  for(cur = (const unsigned char *) key; *cur; cur++)
+  {
+    first = (first ^ *cur) * 1099511628211UL;
+    second = (second ^ *cur) * 1099511628211UL;
+  }
+
+  char *path = (char *) malloc( strlen(cache->directory) + CACHE_NAME_LENGTH );
+  sprintf(path, "%s/%016llx%016llx", cache->directory,
+      (unsigned long long) first, (unsigned long long) second);
+
+  return path;
+}
+
+static void write_u32(FILE *file, uint32_t value)
+{
+  fwrite(&value, sizeof(uint32_t), 1, file);
+}
+
+static uint32_t read_u32(struct CacheReader *reader)
+{
+  const char *bytes = read_bytes(reader, sizeof(uint32_t));
+  uint32_t value = 0;
+
+  if(bytes != NULL)
+    memcpy(&value, bytes, sizeof(uint32_t));
+
+  return value;
+}
+
+/* The next length bytes, or NULL (and not ok any more) if there aren't that
+ *  many left
+ */
+static const char *read_bytes(struct CacheReader *reader, uint32_t length)
+{
+  const char *bytes = reader->cur;
+
+  if(!reader->ok || length > (size_t) (reader->end - reader->cur))
+  {
+    reader->ok = 0;
+    return NULL;
+  }
+
+  reader->cur += length;
+
+  return bytes;
+}
+
+static int count_transitions(struct Transition *root)
+{
+  return 1 + (root->left ? count_transitions(root->left) : 0) +
+    (root->right ? count_transitions(root->right) : 0);
+}
+
+/* Each transition is its symbol's name, then the states it goes to */
+static void write_transitions(FILE *file, struct Transition *root,
+    struct SymbolTable *symbols)
+{
+  int i;
+
+  if(root->left != NULL)
+    write_transitions(file, root->left, symbols);
+
+  const char *name = symbol_name(symbols, root->value);
+  uint32_t length = (name != NULL) ? strlen(name) : 0;
+
+  write_u32(file, length);
+  fwrite(name, 1, length, file);
+  write_u32(file, root->num_to);
+
+  for(i = 0; i < root->num_to; i++)
+    write_u32(file, root->to[i]->index);
+
+  if(root->right != NULL)
+    write_transitions(file, root->right, symbols);
+}
+
+/* How big all the entries are put together, and (if entries isn't NULL)
+ *  what they are
+ */
+static size_t measure_directory(struct CompileCache *cache,
+    struct CacheEntry **entries, int *num_entries)
+{
+  DIR *directory = opendir(cache->directory);
+  struct dirent *entry;
+  size_t total = 0;
+  int count = 0;
+
+  if(directory == NULL)
+    return 0;
+
+  char *path = (char *) malloc( strlen(cache->directory) + 258 );
+
+  while((entry = readdir(directory)) != NULL)
+  {
+    struct stat info;
+
+    /* Temporary files (and . and ..), or anything else that isn't named
+     *  like an entry, are none of our business
+     */
+    if(!is_entry_name(entry->d_name))
+      continue;
+
+    sprintf(path, "%s/%s", cache->directory, entry->d_name);
+
+    if(stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+      continue;
+
+    total += info.st_size;
+
+    if(entries != NULL)
+    {
+      *entries = (struct CacheEntry *) realloc(*entries,
+          (count + 1) * sizeof(struct CacheEntry));
+
+      strcpy((*entries)[count].name, entry->d_name);
+      (*entries)[count].last_used = info.st_mtime;
+      (*entries)[count].size = info.st_size;
+    }
+
+    count++;
+  }
+
+  closedir(directory);
+  free(path);
+
+  if(num_entries != NULL)
+    *num_entries = count;
+
+  return total;
+}
+
+/* Delete the entries used longest ago until the cache is down to three
+ *  quarters of its limit, so it isn't back here again after one more store
+ */
+static void evict(struct CompileCache *cache)
+{
+  struct CacheEntry *entries = NULL;
+  int num_entries = 0, i;
+
+  cache->bytes_used = measure_directory(cache, &entries, &num_entries);
+
+  if(num_entries > 0)
+    qsort(entries, num_entries, sizeof(struct CacheEntry), compare_last_used);
+
+  char *path = (char *) malloc( strlen(cache->directory) + CACHE_NAME_LENGTH );
+
+  for(i = 0; i < num_entries && cache->bytes_used > cache->max_bytes / 4 * 3;
+      i++)
+  {
+    sprintf(path, "%s/%s", cache->directory, entries[i].name);
+
+    /* Only ever delete what the cache wrote */
+    if(is_entry_file(path) && unlink(path) == 0)
+      cache->bytes_used -= entries[i].size;
+  }
+
+  free(path);
+  free(entries);
+}
+
+/* Is a file named the way entry_path() names them? */
+static int is_entry_name(const char *name)
+{
+  int i;
+
+  for(i = 0; i < CACHE_HASH_DIGITS; i++)
+    if(!((name[i] >= '0' && name[i] <= '9') ||
+          (name[i] >= 'a' && name[i] <= 'f')))
+      return 0;
+
+  return name[CACHE_HASH_DIGITS] == '\0';
+}
+
+/* Does a file start the way compile_cache_store() starts them? */
+static int is_entry_file(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  char magic[4];
+  int is_entry;
+
+  if(file == NULL)
+    return 0;
+
+  is_entry = fread(magic, 1, 4, file) == 4 &&
+    memcmp(magic, CACHE_MAGIC, 4) == 0;
+
+  fclose(file);
+
+  return is_entry;
+}
+
+static int compare_last_used(const void *left, const void *right)
+{
+  const struct CacheEntry *l = (const struct CacheEntry *) left;
+  const struct CacheEntry *r = (const struct CacheEntry *) right;
+
+  return (l->last_used > r->last_used) - (l->last_used < r->last_used);
+}
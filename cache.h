@@ -0,0 +1,58 @@
+/* Headers for the on-disk cache of compiled automata
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* How much a cache may take up on disk if nobody says otherwise */
+#define CACHE_DEFAULT_MAX_BYTES (64 << 20)
+
+/*
+ * A directory of compiled DFAs, one file each, named for a hash of whatever
+ *  they were compiled from: the regexp's text, and anything else that
+ *  changes the result, such as the alphabet. That text is kept in the file
+ *  too, so a hash that collides just misses. The directory is one the cache
+ *  makes for itself, inside the one it's opened in.
+ *
+ * Files are written under a temporary name and renamed into place, so
+ *  nobody ever reads half of one, even with several programs sharing the
+ *  directory. Reading a file touches it, and once the directory gets bigger
+ *  than max_bytes, the files read least recently are deleted. Only files
+ *  named and started the way the cache writes them count, or get deleted.
+ *
+ * Several threads can store at once. Loading interns symbols, so only one
+ *  thread at a time should load into the same symbol table.
+ */
+struct CompileCache
+{
+  char *directory;
+  size_t max_bytes;
+  size_t bytes_used;
+
+  long hits;
+  long misses;
+
+  pthread_mutex_t lock;
+};
+
+/* Open the cache in a directory, making it (and the cache's own directory
+ *  inside it) if it isn't there. Returns NULL if it can't be used.
+ */
+struct CompileCache *open_compile_cache(const char *directory,
+    size_t max_bytes);
+void close_compile_cache(struct CompileCache *cache);
+
+/* The DFA compiled from key, made in arena with its symbols interned in
+ *  symbols, or NULL if it isn't cached
+ */
+struct FSM *compile_cache_load(struct CompileCache *cache, const char *key,
+    struct Arena *arena, struct SymbolTable *symbols);
+
+/* Remember the DFA compiled from key. Returns 0 if it couldn't. */
+int compile_cache_store(struct CompileCache *cache, const char *key,
+    struct FSM *dfa, struct SymbolTable *symbols);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * dfa_file.c | Writing DFA tables to files, and mapping them back in
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fsm.h"
+#include "dfa_table.h"
+#include "dfa_file.h"
+
+static uint64_t align_offset(uint64_t offset);
+static int write_section(FILE *file, uint64_t offset, const void *data,
+    size_t size);
+static int section_fits(uint64_t offset, uint64_t size, uint64_t file_size);
+
+int write_dfa_table(struct DFATable *table, const char *path)
+{
+  struct DFAFileHeader header;
+  size_t rows = table->num_states;
+  int written;
+
+  /* Lay the sections out one after the other */
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DFA_FILE_MAGIC, sizeof(header.magic));
+  header.version = DFA_FILE_VERSION;
+  header.byte_order = DFA_FILE_BYTE_ORDER;
+  header.num_states = table->num_states;
+  header.start = table->start;
+  header.num_classes = table->num_classes;
+  header.num_patterns = table->pattern_start[rows];
+
+  header.classes_offset = align_offset(sizeof(header));
+  header.next_offset =
+    align_offset(header.classes_offset + DFA_TABLE_COLUMNS);
+  header.accepting_offset = align_offset(header.next_offset +
+      rows * table->num_classes * sizeof(uint32_t));
+  header.pattern_start_offset = align_offset(header.accepting_offset +
+      (rows + 31) / 32 * sizeof(uint32_t));
+  header.patterns_offset = align_offset(header.pattern_start_offset +
+      (rows + 1) * sizeof(uint32_t));
+  header.file_size = align_offset(header.patterns_offset +
+      header.num_patterns * sizeof(int));
+
+  /* Write it all under a name nobody will look for, then put it in place in
+   *  one go. Anything that has the old file mapped keeps the old one.
+   */
+  char *temporary = (char *) malloc( strlen(path) + 8 );
+  sprintf(temporary, "%s.XXXXXX", path);
+
+  int fd = mkstemp(temporary);
+  FILE *file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+
+  if(file == NULL)
+  {
+    if(fd >= 0)
+    {
+      close(fd);
+      unlink(temporary);
+    }
+
+    free(temporary);
+    return 0;
+  }
+
+  /* mkstemp() makes it private, but it's meant to be shared */
+  fchmod(fd, 0644);
+
+  written = write_section(file, 0, &header, sizeof(header)) &&
+    write_section(file, header.classes_offset, table->classes,
+        DFA_TABLE_COLUMNS) &&
+    write_section(file, header.next_offset, table->next,
+        rows * table->num_classes * sizeof(uint32_t)) &&
+    write_section(file, header.accepting_offset, table->accepting,
+        (rows + 31) / 32 * sizeof(uint32_t)) &&
+    write_section(file, header.pattern_start_offset, table->pattern_start,
+        (rows + 1) * sizeof(uint32_t)) &&
+    write_section(file, header.patterns_offset, table->patterns,
+        header.num_patterns * sizeof(int)) &&
+    write_section(file, header.file_size, NULL, 0);
+
+  if(fclose(file) != 0)
+    written = 0;
+
+  if(!written || rename(temporary, path) != 0)
+  {
+    unlink(temporary);
+    written = 0;
+  }
+
+  free(temporary);
+
+  return written;
+}
+
+struct DFATable *map_dfa_table(const char *path)
+{
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0)
+    return NULL;
+
+  if(fstat(fd, &info) != 0 ||
+      (size_t) info.st_size < sizeof(struct DFAFileHeader))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = info.st_size;
+  char *base = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+  /* The mapping holds on to the file by itself */
+  close(fd);
+
+  if(base == MAP_FAILED)
+    return NULL;
+
+  struct DFAFileHeader *header = (struct DFAFileHeader *) base;
+  uint64_t rows = header->num_states;
+  int ok, b;
+
+  ok = memcmp(header->magic, DFA_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+    header->version == DFA_FILE_VERSION &&
+    header->byte_order == DFA_FILE_BYTE_ORDER &&
+    header->file_size == size &&
+    rows > 0 && header->start < rows &&
+    header->num_classes > 0 && header->num_classes <= DFA_TABLE_COLUMNS &&
+    section_fits(header->classes_offset, DFA_TABLE_COLUMNS, size) &&
+    section_fits(header->next_offset,
+        rows * header->num_classes * sizeof(uint32_t), size) &&
+    section_fits(header->accepting_offset,
+        (rows + 31) / 32 * sizeof(uint32_t), size) &&
+    section_fits(header->pattern_start_offset,
+        (rows + 1) * sizeof(uint32_t), size) &&
+    section_fits(header->patterns_offset,
+        (uint64_t) header->num_patterns * sizeof(int), size);
+
+  struct DFATable *table = NULL;
+
+  if(ok)
+  {
+    table = (struct DFATable *) malloc( sizeof(struct DFATable) );
+
+    table->classes = (uint8_t *) (base + header->classes_offset);
+    table->num_classes = header->num_classes;
+    table->next = (uint32_t *) (base + header->next_offset);
+    table->accepting = (uint32_t *) (base + header->accepting_offset);
+    table->num_states = header->num_states;
+    table->start = header->start;
+    table->pattern_start = (uint32_t *) (base + header->pattern_start_offset);
+    table->patterns = (int *) (base + header->patterns_offset);
+    table->mapping = base;
+    table->mapping_size = size;
+
+    /* A byte out of range would send matching off the end of a row. That,
+     *  and the last pattern_start, are cheap enough to check.
+     */
+    for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+      if(table->classes[b] >= table->num_classes)
+        ok = 0;
+
+    if(table->pattern_start[rows] != header->num_patterns)
+      ok = 0;
+  }
+
+  if(!ok)
+  {
+    free(table);
+    munmap(base, size);
+    return NULL;
+  }
+
+  return table;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+  return (offset + DFA_FILE_ALIGNMENT - 1) / DFA_FILE_ALIGNMENT *
+    DFA_FILE_ALIGNMENT;
+}
+
+/* Pad the file out to offset, then write size bytes of data there */
+static int write_section(FILE *file, uint64_t offset, const void *data,
+    size_t size)
+{
+  long at = ftell(file);
+
+  for(; at >= 0 && (uint64_t) at < offset; at++)
+    if(fputc(0, file) == EOF)
+      return 0;
+
+  if(size > 0 && fwrite(data, 1, size, file) != size)
+    return 0;
+
+  return !ferror(file);
+}
+
+/* Does a section start on a boundary and end inside the file? */
+static int section_fits(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+  return offset % DFA_FILE_ALIGNMENT == 0 && offset <= file_size &&
+    size <= file_size - offset;
+}
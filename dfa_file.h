@@ -0,0 +1,69 @@
+/* Headers for DFA tables kept in files that can be mapped straight in
+ */
+
+#ifndef __DFA_FILE_H__
+#define __DFA_FILE_H__
+
+#include <stdint.h>
+
+#define DFA_FILE_MAGIC "RXDFA\r\n\032"
+#define DFA_FILE_VERSION 1
+
+/* Every section starts on a cache line, from the start of the file */
+#define DFA_FILE_ALIGNMENT 64
+
+/* Written as 0x01020304, so a file from a machine with the other byte order
+ *  doesn't read back as that
+ */
+#define DFA_FILE_BYTE_ORDER 0x01020304u
+
+/*
+ * A file holding a DFATable just as it is in memory, so that it can be
+ *  mmap()ed and matched with as it stands, without reading or copying
+ *  anything. Any number of programs can map the same file and share its
+ *  pages.
+ *
+ * The header comes first; the sections after it come in this order, each
+ *  at the offset the header gives for it:
+ *
+ *   classes         DFA_TABLE_COLUMNS bytes, the class of each byte;
+ *   next            num_states * num_classes uint32_ts, the table itself;
+ *   accepting       (num_states + 31) / 32 uint32_ts, one bit per row;
+ *   pattern_start   num_states + 1 uint32_ts;
+ *   patterns        num_patterns ints.
+ *
+ * Numbers are all in the byte order of the machine that wrote the file.
+ */
+struct DFAFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+
+  uint32_t num_states;
+  uint32_t start;
+  uint32_t num_classes;
+  uint32_t num_patterns;
+
+  uint64_t classes_offset;
+  uint64_t next_offset;
+  uint64_t accepting_offset;
+  uint64_t pattern_start_offset;
+  uint64_t patterns_offset;
+  uint64_t file_size;
+};
+
+/* Write a table to path. It's written under another name and renamed into
+ *  place, so programs that have the old file mapped keep it intact.
+ * Returns 0 if it couldn't.
+ */
+int write_dfa_table(struct DFATable *table, const char *path);
+
+/* Map a table written by write_dfa_table() in. Returns NULL if it can't be
+ *  read or isn't a table this can use. The header and sizes are checked,
+ *  but not every entry in the table, so only map files from somewhere you
+ *  trust. delete_dfa_table() unmaps it.
+ */
+struct DFATable *map_dfa_table(const char *path);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * dfa_table.c | Freezing a DFA into a flat transition table, and matching
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "fsm.h"
+#include "dfa_table.h"
+
+#define CACHE_LINE 64
+
+extern void *EPSILON;
+
+static int is_dead_state(struct State *state);
+static int all_transitions_to(struct Transition *root, struct State *to);
+static int fill_row(uint32_t *row, struct Transition *root, int *row_of,
+    symbol_bytes_func symbol_bytes);
+static int find_byte_classes(struct DFATable *table, struct FSM *dfa,
+    int *row_of, symbol_bytes_func symbol_bytes);
+
+struct DFATable *freeze_dfa(struct FSM *dfa, symbol_bytes_func symbol_bytes)
+{
+  struct DFATable *table;
+  uint32_t columns[DFA_TABLE_COLUMNS];
+  int *row_of;
+  int i, b, rows = 1;
+  size_t size;
+
+  /* Work out which row each state gets. Dead states (like the empty
+   *  metastate out of deterministic_fsm()) all share the dead row.
+   */
+  row_of = (int *) malloc( dfa->num_states * sizeof(int) );
+
+  for(i = 0; i < dfa->num_states; i++)
+  {
+    if(dfa->states[i]->index != i)
+    {
+      free(row_of);
+      return NULL;
+    }
+
+    if(is_dead_state(dfa->states[i]))
+      row_of[i] = DFA_TABLE_DEAD;
+    else
+      row_of[i] = rows++;
+  }
+
+  table = (struct DFATable *) malloc( sizeof(struct DFATable) );
+  table->num_states = rows;
+  table->start = row_of[dfa->start_state->index];
+  table->next = NULL;
+  table->pattern_start = NULL;
+  table->patterns = NULL;
+  table->mapping = NULL;
+  table->mapping_size = 0;
+  table->classes = (uint8_t *) malloc( DFA_TABLE_COLUMNS );
+
+  table->accepting = (uint32_t *)
+    calloc( (rows + 31) / 32, sizeof(uint32_t) );
+
+  /* Merge the bytes whose columns would come out the same */
+  if(!find_byte_classes(table, dfa, row_of, symbol_bytes))
+  {
+    free(row_of);
+    delete_dfa_table(table);
+    return NULL;
+  }
+
+  /* aligned_alloc() wants a multiple of the alignment */
+  size = (size_t) rows * table->num_classes * sizeof(uint32_t);
+  size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  table->next = (uint32_t *) aligned_alloc(CACHE_LINE, size);
+  memset(table->next, 0, size);
+
+  /* Count up each row's patterns, then lay them out in row order */
+  table->pattern_start = (uint32_t *) calloc( rows + 1, sizeof(uint32_t) );
+
+  for(i = 0; i < dfa->num_states; i++)
+    if(row_of[i] != DFA_TABLE_DEAD)
+      table->pattern_start[row_of[i] + 1] = dfa->states[i]->num_patterns;
+
+  for(i = 0; i < rows; i++)
+    table->pattern_start[i + 1] += table->pattern_start[i];
+
+  table->patterns = (int *) malloc( table->pattern_start[rows] * sizeof(int) );
+
+  for(i = 0; i < dfa->num_states; i++)
+  {
+    struct State *state = dfa->states[i];
+    int row = row_of[i];
+
+    if(row == DFA_TABLE_DEAD)
+      continue;
+
+    if(state->accepting)
+      table->accepting[row >> 5] |= 1u << (row & 31);
+
+    if(state->num_patterns)
+      memcpy(table->patterns + table->pattern_start[row], state->patterns,
+          state->num_patterns * sizeof(int));
+
+    /* Each column is the same for every byte in its class */
+    memset(columns, 0, sizeof(columns));
+
+    if(state->transitions_tree != NULL)
+      fill_row(columns, state->transitions_tree, row_of, symbol_bytes);
+
+    for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+      table->next[(size_t) row * table->num_classes + table->classes[b]] =
+        columns[b];
+  }
+
+  free(row_of);
+
+  return table;
+}
+
+void delete_dfa_table(struct DFATable *table)
+{
+  if(table->mapping != NULL)
+  {
+    /* Everything's in the mapping */
+    munmap(table->mapping, table->mapping_size);
+    free(table);
+    return;
+  }
+
+  free(table->classes);
+  free(table->next);
+  free(table->accepting);
+  free(table->pattern_start);
+  free(table->patterns);
+  free(table);
+}
+
+int dfa_table_match(struct DFATable *table, const char *input, size_t length)
+{
+  return dfa_table_accepting(table, dfa_table_run(table, input, length));
+}
+
+uint32_t dfa_table_run(struct DFATable *table, const char *input,
+    size_t length)
+{
+  const uint32_t *next = table->next;
+  const unsigned char *cur = (const unsigned char *) input;
+  const unsigned char *end = cur + length;
+  uint32_t state = table->start;
+
+  const uint8_t *classes = table->classes;
+  size_t num_classes = table->num_classes;
+
+  while(cur < end)
+  {
+    state = next[state * num_classes + classes[*cur++]];
+
+    /* Nothing gets out of the dead state, so don't bother with the rest */
+    if(state == DFA_TABLE_DEAD)
+      return DFA_TABLE_DEAD;
+  }
+
+  return state;
+}
+
+/* Work out which bytes can share a column. Two bytes can if their columns
+ *  hash the same, so long as they really are the same all the way down;
+ *  if a hash ever lies, every byte gets its own column.
+ * Returns 0 if the FSM isn't deterministic.
+ */
+static int find_byte_classes(struct DFATable *table, struct FSM *dfa,
+    int *row_of, symbol_bytes_func symbol_bytes)
+{
+  uint32_t columns[DFA_TABLE_COLUMNS];
+  unsigned long hashes[DFA_TABLE_COLUMNS];
+  int first[DFA_TABLE_COLUMNS];
+  int i, b, c;
+
+  for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+    hashes[b] = 14695981039346656037UL;
+
+  for(i = 0; i < dfa->num_states; i++)
+  {
+    struct State *state = dfa->states[i];
+
+    if(row_of[i] == DFA_TABLE_DEAD)
+      continue;
+
+    memset(columns, 0, sizeof(columns));
+
+    if(state->transitions_tree != NULL &&
+        !fill_row(columns, state->transitions_tree, row_of, symbol_bytes))
+      return 0;
+
+    for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+      hashes[b] = (hashes[b] ^ columns[b]) * 1099511628211UL;
+  }
+
+  table->num_classes = 0;
+
+  for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+  {
+    for(c = 0; c < (int) table->num_classes; c++)
+      if(hashes[first[c]] == hashes[b])
+        break;
+
+    if(c == (int) table->num_classes)
+      first[table->num_classes++] = b;
+
+    table->classes[b] = c;
+  }
+
+  /* Check the classes with a second pass */
+  for(i = 0; i < dfa->num_states; i++)
+  {
+    struct State *state = dfa->states[i];
+
+    if(row_of[i] == DFA_TABLE_DEAD || state->transitions_tree == NULL)
+      continue;
+
+    memset(columns, 0, sizeof(columns));
+    fill_row(columns, state->transitions_tree, row_of, symbol_bytes);
+
+    for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+      if(columns[b] != columns[first[table->classes[b]]])
+      {
+        for(b = 0; b < DFA_TABLE_COLUMNS; b++)
+          table->classes[b] = b;
+
+        table->num_classes = DFA_TABLE_COLUMNS;
+        return 1;
+      }
+  }
+
+  return 1;
+}
+
+/* A state is dead if it can't accept and can't go anywhere but itself */
+static int is_dead_state(struct State *state)
+{
+  if(state->accepting)
+    return 0;
+
+  if(state->transitions_tree == NULL)
+    return 1;
+
+  return all_transitions_to(state->transitions_tree, state);
+}
+
+static int all_transitions_to(struct Transition *root, struct State *to)
+{
+  int i;
+
+  for(i = 0; i < root->num_to; i++)
+    if(root->to[i] != to)
+      return 0;
+
+  if(root->left != NULL && !all_transitions_to(root->left, to))
+    return 0;
+
+  if(root->right != NULL && !all_transitions_to(root->right, to))
+    return 0;
+
+  return 1;
+}
+
+static int fill_row(uint32_t *row, struct Transition *root, int *row_of,
+    symbol_bytes_func symbol_bytes)
+{
+  int low, high, b;
+  uint32_t to;
+
+  if(root->left != NULL && !fill_row(row, root->left, row_of, symbol_bytes))
+    return 0;
+
+  /* Anything that isn't a plain one-target byte transition means this
+   *  isn't a DFA.
+   */
+  if(root->value == EPSILON || root->num_to != 1)
+    return 0;
+
+  if(!symbol_bytes(root->value, &low, &high) || low < 0 ||
+      high >= DFA_TABLE_COLUMNS)
+    return 0;
+
+  /* Every column starts out dead, so there's nothing to fill in for going
+   *  nowhere; the alphabet can have symbols that overlap the ones that go
+   *  somewhere (see split_ranges()), but no two of those can share a byte
+   */
+  to = row_of[root->to[0]->index];
+
+  if(to != DFA_TABLE_DEAD)
+    for(b = low; b <= high; b++)
+    {
+      if(row[b] != DFA_TABLE_DEAD && row[b] != to)
+        return 0;
+
+      row[b] = to;
+    }
+
+  if(root->right != NULL && !fill_row(row, root->right, row_of, symbol_bytes))
+    return 0;
+
+  return 1;
+}
@@ -0,0 +1,87 @@
+/* Headers for compiled (frozen) transition-table DFAs
+ */
+
+#ifndef __DFA_TABLE_H__
+#define __DFA_TABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of different input bytes */
+#define DFA_TABLE_COLUMNS 256
+
+/* Row 0 of every table is the dead state: it loops to itself on every byte
+ * and never accepts. Anything the FSM doesn't have a transition for goes
+ * there, so a zeroed row is already a row of dead transitions.
+ */
+#define DFA_TABLE_DEAD 0
+
+/*
+ * A DFA packed into one flat table, so that matching is a couple of lookups
+ * per input byte:
+ *
+ *   next state = next[state * num_classes + classes[byte]]
+ *
+ * Bytes that go to the same place from every state share a class, and so a
+ * column. Most DFAs only tell a few kinds of byte apart, so the rows end up
+ * much narrower than one column per byte, and far more of them fit in cache.
+ *
+ * The table is aligned to a cache line.
+ *
+ * A table can also be mapped from a file (see dfa_file.h), in which case
+ * all of the arrays point into the mapping, and mapping is where it starts.
+ */
+struct DFATable
+{
+  uint8_t *classes;       /* The class of each byte */
+  uint32_t num_classes;
+
+  uint32_t *next;
+  uint32_t *accepting;    /* Bitmap, one bit per row */
+  uint32_t num_states;    /* Number of rows, including the dead one */
+  uint32_t start;
+
+  /* The patterns row r accepts for are patterns[pattern_start[r]] up to
+   *  patterns[pattern_start[r + 1]]
+   */
+  uint32_t *pattern_start;
+  int *patterns;
+
+  void *mapping;          /* NULL unless it's mapped from a file */
+  size_t mapping_size;
+};
+
+/* Freeze a deterministic FSM (such as one returned by deterministic_fsm())
+ *  into a table. symbol_bytes tells us which bytes each symbol stands for;
+ *  no two symbols that go anywhere but a dead state may share a byte (see
+ *  split_ranges()).
+ * Returns NULL if the FSM isn't deterministic.
+ */
+struct DFATable *freeze_dfa(struct FSM *dfa,
+    symbol_bytes_func symbol_bytes);
+
+void delete_dfa_table(struct DFATable *table);
+
+/* Does the table accept exactly this input? */
+int dfa_table_match(struct DFATable *table, const char *input, size_t length);
+
+/* The row the input ends up in, which is DFA_TABLE_DEAD if it can't lead to
+ *  a match any more
+ */
+uint32_t dfa_table_run(struct DFATable *table, const char *input,
+    size_t length);
+
+static inline int dfa_table_accepting(struct DFATable *table, uint32_t state)
+{
+  return (table->accepting[state >> 5] >> (state & 31)) & 1;
+}
+
+/* Which patterns a row accepts for; returns how many */
+static inline int dfa_table_patterns(struct DFATable *table, uint32_t state,
+    const int **patterns)
+{
+  *patterns = table->patterns + table->pattern_start[state];
+  return table->pattern_start[state + 1] - table->pattern_start[state];
+}
+
+#endif
@@ -4,14 +4,27 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "fsm.h"
 #include "dfsm.h"
+#include "nfa_csr.h"
+#include "stats.h"
 
 extern void *EPSILON;
 
+static struct StateArray *move_state_array(struct Arena *arena,
+    struct StateArray *states);
+static int compare_ints(const void *left, const void *right);
+
 struct FSM *deterministic_fsm(struct FSM *ndfa, void **alphabet,
     int num_symbols)
+{
+  return deterministic_fsm_within(ndfa, alphabet, num_symbols, NULL);
+}
+
+struct FSM *deterministic_fsm_within(struct FSM *ndfa, void **alphabet,
+    int num_symbols, struct DeterminizeBudget *budget)
 {
   /* Basic idea behind converting an NFA to a DFA:
    *  In an NFA, we must keep track of the possible states you could be in at
@@ -22,170 +35,656 @@ struct FSM *deterministic_fsm(struct FSM *ndfa, void **alphabet,
    */
 
 
-  struct FSM *dfa;
-  dfa = (struct FSM *) malloc( sizeof(struct FSM) );
+  STATS_START(STATS_DETERMINIZE);
 
-  /* We have to make a list of the possible states that we can start at */
-  struct StateArray *starting_states = (struct StateArray *)
-    malloc( sizeof(struct StateArray) );
-  starting_states->states = (struct State **)
-    malloc( 1 * sizeof(struct State *) );
+  if(budget != NULL)
+  {
+    budget->num_states = 0;
+    budget->bytes_used = 0;
+    budget->exceeded = 0;
+  }
+
+  /* The DFA goes wherever the NFA is */
+  struct FSM *dfa = new_fsm(ndfa->arena);
 
-  /* This will first include, well, the actual start state */
-  starting_states->states[0] = ndfa->start_state;
-  starting_states->num_states = 1;
+  /* Pack the NFA into flat arrays, and work out all the epsilon closures
+   *  we'll ever need, just once
+   */
+  struct CompiledNFA *csr = compile_nfa(ndfa, alphabet, num_symbols);
+  struct EpsilonClosures *closures = compute_epsilon_closures(csr);
 
-  /* And very importantly, the epsilon closure thereof. */
-  epsilon_closure(&starting_states->states, &starting_states->num_states);
+  /* We have to make a list of the possible states that we can start at:
+   *  the actual start state, and very importantly, the epsilon closure
+   *  thereof.
+   */
+  struct StateArray *starting_states = start_states(closures);
 
-  struct State *metastate = new_state(starting_states, ndfa->start_state->cmp);
+  struct State *metastate = new_metastate(dfa->arena, closures,
+      starting_states);
   add_state(dfa, metastate);
   dfa->start_state = metastate;
 
-  /* If any state is accepting within our metastate of start states, the
-   * metastate is also accepting
+  int within_budget = 1, counted = 0;
+
+  /* Every metastate we make goes in here, so we can find it again */
+  struct MetastateTable *table = new_metastate_table();
+  insert_metastate(table, metastate);
+
+  /* GO!
+   *
+   * Metastates get added to the end of dfa->states as they're made, so the
+   *  array doubles as the queue of metastates still to be worked on. Going
+   *  through it in order handles each metastate exactly once, without
+   *  recursing (which big DFAs used to overflow the stack with), and numbers
+   *  the states breadth first from the start state.
    */
-  int i;
-  for(i = 0; i < starting_states->num_states; i++)
-      if(starting_states->states[i]->accepting)
-        metastate->accepting = 1;
+  int next;
+  for(next = 0; next < dfa->num_states && within_budget; next++)
+  {
+    build_dfa_from_metastate(dfa, closures, table, dfa->states[next]);
+
+    /* Count up every metastate that's been made since last time */
+    for(; budget != NULL && within_budget && counted < dfa->num_states;
+        counted++)
+      within_budget = spend_budget(budget, metastate_size(
+            (struct StateArray *) dfa->states[counted]->id,
+            csr->num_symbols));
+  }
+
+  delete_metastate_table(table);
+  delete_epsilon_closures(closures);
+  delete_compiled_nfa(csr);
+
+  if(!within_budget)
+  {
+    /* The arena keeps what's in it till it goes; the heap gets it all back */
+    if(dfa->arena == NULL)
+    {
+      for(next = 0; next < dfa->num_states; next++)
+        delete_state_array((struct StateArray *) dfa->states[next]->id);
+
+      delete_fsm(dfa);
+    }
+
+    STATS_STOP(STATS_DETERMINIZE);
+
+    return NULL;
+  }
 
-  /* GO! */
-  build_dfa_from_metastate(dfa, metastate, alphabet, num_symbols);
+  STATS_STOP(STATS_DETERMINIZE);
 
   return dfa;
 }
 
-void build_dfa_from_metastate(struct FSM *dfa, struct State *metastate,
-    void **alphabet, int num_symbols)
+struct State *new_metastate(struct Arena *arena,
+    struct EpsilonClosures *closures, struct StateArray *states)
 {
+  struct CompiledNFA *csr = closures->csr;
+  int i;
 
-  int i, j;
+  if(arena != NULL)
+    states = move_state_array(arena, states);
+
+  struct State *metastate = new_state(arena, states);
+
+  /* If any state is accepting within our metastate, the metastate is also
+   * accepting
+   */
+  for(i = 0; i < states->num_words; i++)
+    if(states->bits[i] & csr->accepting[i])
+      metastate->accepting = 1;
+
+  /* And it accepts for every pattern they do */
+  if(metastate->accepting)
+  {
+    int *patterns;
+    int num_patterns = patterns_of(closures, states, &patterns);
+
+    set_patterns(metastate, patterns, num_patterns);
+    free(patterns);
+  }
+
+  return metastate;
+}
+
+int patterns_of(struct EpsilonClosures *closures, struct StateArray *states,
+    int **ref_patterns)
+{
+  struct CompiledNFA *csr = closures->csr;
+  int *patterns = NULL;
+  int i, j, num_patterns = 0;
+
+  for(i = 0; i < states->num_words; i++)
+  {
+    unsigned long word = states->bits[i] & csr->accepting[i];
+
+    while(word)
+    {
+      struct State *state =
+        csr->nfa->states[i * STATE_ARRAY_BITS + __builtin_ctzl(word)];
+
+      if(state->num_patterns)
+      {
+        patterns = (int *) realloc(patterns,
+            (num_patterns + state->num_patterns) * sizeof(int));
+
+        for(j = 0; j < state->num_patterns; j++)
+          patterns[num_patterns++] = state->patterns[j];
+      }
+
+      word &= word - 1;
+    }
+  }
+
+  /* Sort them, and drop the repeats */
+  if(num_patterns > 1)
+  {
+    qsort(patterns, num_patterns, sizeof(int), compare_ints);
+
+    for(i = j = 1; i < num_patterns; i++)
+      if(patterns[i] != patterns[j - 1])
+        patterns[j++] = patterns[i];
+
+    num_patterns = j;
+  }
+
+  *ref_patterns = patterns;
+
+  return num_patterns;
+}
+
+static int compare_ints(const void *left, const void *right)
+{
+  int l = *(const int *) left, r = *(const int *) right;
+
+  return (l > r) - (l < r);
+}
+
+size_t metastate_size(struct StateArray *states, int num_symbols)
+{
+  return sizeof(struct State) + sizeof(struct StateArray) +
+    states->num_words * sizeof(unsigned long) +
+    states->num_states * sizeof(struct State *) +
+    num_symbols * (sizeof(struct Transition) + sizeof(struct State *));
+}
+
+int spend_budget(struct DeterminizeBudget *budget, size_t bytes)
+{
+  budget->num_states++;
+  budget->bytes_used += bytes;
+
+  if((budget->max_states > 0 && budget->num_states > budget->max_states) ||
+      (budget->max_bytes > 0 && budget->bytes_used > budget->max_bytes))
+    budget->exceeded = 1;
+
+  return !budget->exceeded;
+}
+
+void build_dfa_from_metastate(struct FSM *dfa, struct EpsilonClosures *closures,
+    struct MetastateTable *table, struct State *metastate)
+{
+
+  int i, c;
   struct State *link_to;
+  struct CompiledNFA *csr = closures->csr;
 
-  /* Test each possible symbol from this metastate */
-  for(i = 0; i < num_symbols; i++)
+  /* Test each class of symbols from this metastate. They all go to the same
+   *  place, so only the first of each needs working out.
+   */
+  for(c = 0; c < csr->num_classes; c++)
   {
     struct StateArray *states = (struct StateArray *) metastate->id;
     
     struct StateArray *possible_states =
-      possible_states_from(states, alphabet[i]);
+      possible_states_from(closures, states, csr->class_symbol[c]);
 
     /* Check if the possible state metastate already exists */
-    link_to = NULL;
-    for(j = 0; j < dfa->num_states; j++)
+    link_to = find_metastate(table, possible_states);
+
+    if(link_to)
     {
-      if(are_state_arrays_equal(possible_states,
-            (struct StateArray *) dfa->states[j]->id))
-      {
-        link_to = dfa->states[j];
-        break;
-      } 
+      /* It does, so this copy of the set isn't needed */
+      delete_state_array(possible_states);
     }
-
-    /* If it doesn't, make it */
-    if(!link_to)
+    else
     {
-      link_to = new_state(possible_states, metastate->cmp);
-
-      for(j = 0; j < possible_states->num_states; j++)
-        if(possible_states->states[j]->accepting)
-          link_to->accepting = 1;
-      
+      /* It doesn't, so make it, and put it on the end of the queue */
+      link_to = new_metastate(dfa->arena, closures, possible_states);
       add_state(dfa, link_to);
+      insert_metastate(table, link_to);
     }
 
-    /* Now connect this metastate to the one it should link to */
-    add_transition(metastate, link_to, alphabet[i]);
-
-    /* And recurse!
-     *
-     * To avoid infinite looping, make sure the thing we're pointing to
-     * hasn't already been started.
-     * This should cause each metastate to be searched exactly once:
-     *  If a transition from it's been defined, it either has all
-     *    transitions already defined
-     *  or the function adding transitions to that particular state is still
-     *    on the call stack.
+    /* Now connect this metastate to the one it should link to, on every
+     *  symbol in the class
      */
-    if(link_to->transitions_tree == NULL)
-      build_dfa_from_metastate(dfa, link_to, alphabet, num_symbols);
+    for(i = csr->class_symbol[c]; i >= 0; i = csr->next_in_class[i])
+      add_transition(metastate, link_to, csr->symbols[i]);
   }
 
 }
 
 int are_state_arrays_equal(struct StateArray *left, struct StateArray *right)
 {
-  if(left->num_states != right->num_states)
+  if(left->num_states != right->num_states ||
+      left->num_words != right->num_words)
     return 0;
 
-  int i, j;
+  int i;
+  for(i = 0; i < left->num_words; i++)
+    if(left->bits[i] != right->bits[i])
+      return 0;
+
+  return 1;
+}
+
+unsigned long hash_state_array(struct StateArray *states)
+{
+  /* FNV-1a over the words of the bitset */
+  unsigned long hash = 14695981039346656037UL;
+  int i;
 
-  for(i = 0; i < left->num_states; i++)
+  for(i = 0; i < states->num_words; i++)
   {
-    int found = 0;
-    
-    /* They won't necessarily be in the same order.
-     * And I'm a lazy programmer.
-     * So this is O(n^2) for now.
-     */
-    for(j = 0; j < right->num_states; j++)
-    {
-      if(left->states[i] == right->states[j])
-        found = 1;
-    }
+    hash ^= states->bits[i];
+    hash *= 1099511628211UL;
+  }
 
-    if(!found)
-      return 0;
+  /* Multiplying only carries bits upwards, and the table uses the low bits,
+   *  so fold the high bits back down.
+   */
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdUL;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+struct MetastateTable *new_metastate_table()
+{
+  struct MetastateTable *table = (struct MetastateTable *)
+    malloc( sizeof(struct MetastateTable) );
+
+  table->num_buckets = 64;
+  table->num_metastates = 0;
+  table->buckets = (struct State **)
+    calloc( table->num_buckets, sizeof(struct State *) );
+
+  return table;
+}
+
+void delete_metastate_table(struct MetastateTable *table)
+{
+  free(table->buckets);
+  free(table);
+}
+
+struct State *find_metastate(struct MetastateTable *table,
+    struct StateArray *states)
+{
+  unsigned long mask = table->num_buckets - 1;
+  unsigned long i = hash_state_array(states) & mask;
+
+  while(table->buckets[i] != NULL)
+  {
+    STATS_COUNT(metastate_comparisons);
+
+    if(are_state_arrays_equal(states,
+          (struct StateArray *) table->buckets[i]->id))
+      return table->buckets[i];
+
+    i = (i + 1) & mask;
   }
 
-  return 1;
+  return NULL;
 }
 
-struct StateArray *possible_states_from(struct StateArray *states, void *input)
+void insert_metastate(struct MetastateTable *table, struct State *metastate)
 {
-  int num_possible_next_states = 0, i, j;
+  unsigned long mask, i;
+
+  /* Keep the table at most half full, doubling it (and rehashing
+   *  everything) when it gets there.
+   */
+  if(2 * (table->num_metastates + 1) > table->num_buckets)
+  {
+    struct State **old_buckets = table->buckets;
+    int j, old_num_buckets = table->num_buckets;
 
-  struct StateArray *possible_next_states = (struct StateArray *)
-    malloc( sizeof(struct StateArray));
+    table->num_buckets *= 2;
+    table->num_metastates = 0;
+    table->buckets = (struct State **)
+      calloc( table->num_buckets, sizeof(struct State *) );
 
-  possible_next_states->num_states = 0;
+    for(j = 0; j < old_num_buckets; j++)
+      if(old_buckets[j] != NULL)
+        insert_metastate(table, old_buckets[j]);
 
-  for(i = 0; i < states->num_states; i++)
+    free(old_buckets);
+  }
+
+  mask = table->num_buckets - 1;
+  i = hash_state_array((struct StateArray *) metastate->id) & mask;
+
+  while(table->buckets[i] != NULL)
+    i = (i + 1) & mask;
+
+  table->buckets[i] = metastate;
+  table->num_metastates++;
+}
+
+struct EpsilonClosures *compute_epsilon_closures(struct CompiledNFA *csr)
+{
+  /* Tarjan's strongly connected components algorithm, over only the epsilon
+   *  transitions, done with explicit stacks so that long epsilon chains
+   *  can't overflow the C stack.
+   * Tarjan finishes each component only after every component reachable
+   *  from it, so by the time we finish one, the closures of everything it
+   *  has epsilon transitions to are already done.
+   */
+  int n = csr->num_states, num_words = (n + STATE_ARRAY_BITS - 1) /
+    STATE_ARRAY_BITS;
+  int i, j, counter = 0, num_components = 0, used = 0, allocated = n;
+
+  STATS_START(STATS_CLOSURE);
+
+  struct EpsilonClosures *closures = (struct EpsilonClosures *)
+    malloc( sizeof(struct EpsilonClosures) );
+
+  closures->csr = csr;
+  closures->num_words = num_words;
+  closures->offset = (int *) malloc( n * sizeof(int) );
+  closures->first = (int *) malloc( n * sizeof(int) );
+  closures->length = (int *) malloc( n * sizeof(int) );
+  closures->words = (unsigned long *)
+    malloc( allocated * sizeof(unsigned long) );
+
+  int *order = (int *) malloc( n * sizeof(int) );
+  int *low = (int *) malloc( n * sizeof(int) );
+  int *component = (int *) malloc( n * sizeof(int) );
+  int *next_edge = (int *) malloc( n * sizeof(int) );
+  int *calls = (int *) malloc( n * sizeof(int) );
+  int *tarjan = (int *) malloc( n * sizeof(int) );
+  int num_calls = 0, num_tarjan = 0;
+
+  /* Scratch space for building a closure in full before it's trimmed */
+  unsigned long *scratch = (unsigned long *)
+    calloc( num_words + 1, sizeof(unsigned long) );
+
+  for(i = 0; i < n; i++)
+  {
+    order[i] = -1;
+    component[i] = -1;
+  }
+
+  for(i = 0; i < n; i++)
   {
-    struct Transition *from_here =
-      transition_from_with_input(states->states[i], input);
+    if(order[i] != -1)
+      continue;
+
+    order[i] = low[i] = counter++;
+    next_edge[i] = 0;
+    calls[num_calls++] = i;
+    tarjan[num_tarjan++] = i;
+
+    while(num_calls)
+    {
+      int v = calls[num_calls - 1];
+
+      if(csr->epsilon_start[v] + next_edge[v] < csr->epsilon_start[v + 1])
+      {
+        int w = csr->epsilon[csr->epsilon_start[v] + next_edge[v]++];
+
+        if(order[w] == -1)
+        {
+          /* Haven't been there yet, so "call" it */
+          order[w] = low[w] = counter++;
+          next_edge[w] = 0;
+          calls[num_calls++] = w;
+          tarjan[num_tarjan++] = w;
+        }
+        else if(component[w] == -1 && order[w] < low[v])
+          /* Still on the Tarjan stack, so part of v's component */
+          low[v] = order[w];
+
+        continue;
+      }
+
+      /* Done with all of v's transitions: "return" from it */
+      num_calls--;
+      if(num_calls && low[v] < low[calls[num_calls - 1]])
+        low[calls[num_calls - 1]] = low[v];
+
+      if(low[v] != order[v])
+        continue;
+
+      /* v is the root of a component: pop the component off the stack and
+       *  build its closure out of its members and the closures of the
+       *  components it leads to.
+       */
+      int first = num_words, last = -1, start = num_tarjan;
+
+      do
+        component[tarjan[--start]] = num_components;
+      while(tarjan[start] != v);
+
+      for(j = start; j < num_tarjan; j++)
+      {
+        int member = tarjan[j], k, w;
+
+        scratch[member / STATE_ARRAY_BITS] |=
+          1UL << (member % STATE_ARRAY_BITS);
+
+        if(member / (int) STATE_ARRAY_BITS < first)
+          first = member / STATE_ARRAY_BITS;
+        if(member / (int) STATE_ARRAY_BITS > last)
+          last = member / STATE_ARRAY_BITS;
+
+        for(k = csr->epsilon_start[member];
+            k < csr->epsilon_start[member + 1]; k++)
+        {
+          w = csr->epsilon[k];
+          if(component[w] == num_components)
+            continue;
+
+          unsigned long *from = closures->words + closures->offset[w];
+          int l;
+
+          for(l = 0; l < closures->length[w]; l++)
+            scratch[closures->first[w] + l] |= from[l];
+
+          if(closures->first[w] < first)
+            first = closures->first[w];
+          if(closures->first[w] + closures->length[w] - 1 > last)
+            last = closures->first[w] + closures->length[w] - 1;
+        }
+      }
+
+      /* Trim it down to the words that matter and stash it */
+      if(used + last - first + 1 > allocated)
+      {
+        while(used + last - first + 1 > allocated)
+          allocated *= 2;
+        closures->words = (unsigned long *) realloc(closures->words,
+            allocated * sizeof(unsigned long));
+      }
 
-    if(from_here != NULL)
-      for(j = 0; j < from_here->num_to; j++)
-        add_if_not_present((void ***) &possible_next_states->states,
-            &possible_next_states->num_states, from_here->to[j]);
+      for(j = first; j <= last; j++)
+      {
+        closures->words[used + j - first] = scratch[j];
+        scratch[j] = 0;
+      }
+
+      for(j = start; j < num_tarjan; j++)
+      {
+        closures->offset[tarjan[j]] = used;
+        closures->first[tarjan[j]] = first;
+        closures->length[tarjan[j]] = last - first + 1;
+      }
+
+      used += last - first + 1;
+      num_tarjan = start;
+      num_components++;
+    }
   }
 
-  epsilon_closure(&possible_next_states->states,
-      &possible_next_states->num_states);
+  free(order);
+  free(low);
+  free(component);
+  free(next_edge);
+  free(calls);
+  free(tarjan);
+  free(scratch);
 
-  return possible_next_states;
+  /* Every epsilon edge gets followed once */
+  STATS_ADD(closure_steps, csr->epsilon_start[n]);
+  STATS_STOP(STATS_CLOSURE);
+
+  return closures;
+}
+
+void delete_epsilon_closures(struct EpsilonClosures *closures)
+{
+  free(closures->offset);
+  free(closures->first);
+  free(closures->length);
+  free(closures->words);
+  free(closures);
+}
+
+struct StateArray *new_state_array(struct EpsilonClosures *closures)
+{
+  struct StateArray *states = (struct StateArray *)
+    malloc( sizeof(struct StateArray) );
+
+  states->states = NULL;
+  states->num_states = 0;
+  states->num_words = closures->num_words;
+  states->bits = (unsigned long *)
+    calloc( states->num_words, sizeof(unsigned long) );
+
+  return states;
+}
+
+void delete_state_array(struct StateArray *states)
+{
+  free(states->states);
+  free(states->bits);
+  free(states);
+}
+
+/* Copy a set of states into an arena, deleting the original */
+static struct StateArray *move_state_array(struct Arena *arena,
+    struct StateArray *states)
+{
+  struct StateArray *copy = (struct StateArray *)
+    arena_alloc( arena, sizeof(struct StateArray) );
+
+  copy->num_states = states->num_states;
+  copy->num_words = states->num_words;
+  copy->states = (struct State **)
+    arena_alloc( arena, states->num_states * sizeof(struct State *) );
+  copy->bits = (unsigned long *)
+    arena_alloc( arena, states->num_words * sizeof(unsigned long) );
+
+  memcpy(copy->states, states->states,
+      states->num_states * sizeof(struct State *));
+  memcpy(copy->bits, states->bits, states->num_words * sizeof(unsigned long));
+
+  delete_state_array(states);
+
+  return copy;
 }
 
-void epsilon_closure(struct State ***possible_states, int *num_possible_states)
+void fill_state_array(struct EpsilonClosures *closures,
+    struct StateArray *states)
 {
-  int previous_num, i, j;
-  do
+  int i, count = 0;
+
+  for(i = 0; i < states->num_words; i++)
+    count += __builtin_popcountl(states->bits[i]);
+
+  states->states = (struct State **)
+    realloc(states->states, count * sizeof(struct State *));
+  states->num_states = 0;
+
+  for(i = 0; i < states->num_words; i++)
   {
-    previous_num = (*num_possible_states);
+    unsigned long word = states->bits[i];
 
-    for(i = 0; i < (*num_possible_states); i++)
+    while(word)
     {
-      struct Transition *epsilon =
-        transition_from_with_input((*possible_states)[i], EPSILON);
+      int bit = __builtin_ctzl(word);
+      states->states[states->num_states++] =
+        closures->csr->nfa->states[i * STATE_ARRAY_BITS + bit];
+      word &= word - 1;
+    }
+  }
+}
+
+/* OR the closure of one state into a set */
+static inline void add_closure(struct EpsilonClosures *closures,
+    struct StateArray *states, int index)
+{
+  unsigned long *to = states->bits + closures->first[index];
+  unsigned long *from = closures->words + closures->offset[index];
+  int i, length = closures->length[index];
+
+  STATS_COUNT(closure_steps);
+
+  for(i = 0; i < length; i++)
+    to[i] |= from[i];
+}
 
-      if(epsilon != NULL)
-        for(j = 0; j < epsilon->num_to; j++)
-          add_if_not_present((void ***) possible_states,
-              num_possible_states, epsilon->to[j]);
+struct StateArray *start_states(struct EpsilonClosures *closures)
+{
+  struct StateArray *states = new_state_array(closures);
+
+  add_closure(closures, states, closures->csr->start);
+  fill_state_array(closures, states);
+
+  return states;
+}
+
+void epsilon_closure(struct EpsilonClosures *closures,
+    struct StateArray *states)
+{
+  int i;
+
+  for(i = 0; i < states->num_states; i++)
+    add_closure(closures, states, states->states[i]->index);
+
+  fill_state_array(closures, states);
+}
+
+struct StateArray *possible_states_from(struct EpsilonClosures *closures,
+    struct StateArray *states, int symbol)
+{
+  struct CompiledNFA *csr = closures->csr;
+  int i, j;
+
+  struct StateArray *possible_next_states = new_state_array(closures);
+
+  /* Closing over the states we get to is just ORing in their closures */
+  for(i = 0; i < states->num_words; i++)
+  {
+    unsigned long word = states->bits[i];
+
+    while(word)
+    {
+      int from = i * STATE_ARRAY_BITS + __builtin_ctzl(word);
+      word &= word - 1;
+
+      /* Edges are sorted by symbol, so stop once we're past it */
+      for(j = csr->edge_start[from]; j < csr->edge_start[from + 1] &&
+          csr->edges[j].symbol <= symbol; j++)
+        if(csr->edges[j].symbol == symbol)
+          add_closure(closures, possible_next_states, csr->edges[j].target);
     }
-  } while(previous_num != (*num_possible_states));
+  }
+
+  fill_state_array(closures, possible_next_states);
+
+  return possible_next_states;
 }
 
 int add_if_not_present(void ***ref_array, int *size, void *item)
@@ -197,6 +696,7 @@ int add_if_not_present(void ***ref_array, int *size, void *item)
       if((*ref_array)[i] == item)
         return 0;
 
+    STATS_COUNT(reallocs);
     (*ref_array) = realloc((*ref_array), ++(*size) * sizeof((*ref_array)[0]));
     (*ref_array)[*size - 1] = item;
     return 1;
@@ -8,31 +8,151 @@
 /* We define EPSILON here as just a memory location. All pointers to an epsilon
  * transition shall use this memory location, and nothing that isn't this memory
  * location shall be epsilon.
+ * The one definition lives in fsm.c.
  */
-void *EPSILON;
+extern void *EPSILON;
 
+/* Bitsets of states are made of these, one bit per state index */
+#define STATE_ARRAY_BITS (8 * sizeof(unsigned long))
+
+/* A set of states out of one FSM.
+ * The set itself is the bitset, indexed by State index. states lists the
+ *  same members in index order, for anything that wants to walk them.
+ * The bitset doubles as a canonical key for the set.
+ */
 struct StateArray
 {
   struct State **states;
   int num_states;
+
+  unsigned long *bits;
+  int num_words;
+};
+
+/* The epsilon closure of every state in an NFA, worked out once up front.
+ * States in the same strongly connected component of epsilon transitions
+ *  share one closure. Each closure only stores the words between its first
+ *  and last set bit, which keeps Thompson NFAs (where closures are mostly
+ *  made of nearby states) from needing a full bitset per state.
+ */
+struct EpsilonClosures
+{
+  struct CompiledNFA *csr;
+  int num_words;      /* Words in a bitset over all the NFA's states */
+
+  int *offset;        /* Where each state's closure starts in words */
+  int *first;         /* Word of the full bitset that offset stands for */
+  int *length;        /* How many words the closure has from there */
+  unsigned long *words;
+};
+
+/* Hash table from the set of NFA states in a metastate to the DFA state
+ * made for it. Open addressing with linear probing; buckets hold the DFA
+ * states themselves, whose ids are their StateArrays.
+ */
+struct MetastateTable
+{
+  struct State **buckets;
+  int num_buckets;
+  int num_metastates;
 };
 
 /* Make a deterministic FSM out of a non-deterministic one
  * Accepts an array of symbols in the alphabet, so it knows what to check
+ * The DFA is allocated from the NFA's arena. Its states' ids are the sets of
+ *  NFA states they stand for, which are in the arena too if there is one.
  */
 struct FSM *deterministic_fsm(struct FSM *ndfa, void **alphabet,
     int num_symbols);
 
-/* Function used by deterministic_fsm() to recursively build the DFA */
-void build_dfa_from_metastate(struct FSM *dfa, struct State *metastate,
-    void **alphabet, int num_symbols);
+/* How big a DFA gets if nobody says otherwise */
+#define DFA_DEFAULT_MAX_BYTES ((size_t) 1 << 30)
+
+/* Limits on how big subset construction may let a DFA get, 0 meaning no
+ *  limit, and how big it actually got. Bytes are counted for each
+ *  metastate (the State, its set of NFA states, its transitions) as it's
+ *  made, since it's those that blow up.
+ */
+struct DeterminizeBudget
+{
+  int max_states;
+  size_t max_bytes;
+
+  int num_states;
+  size_t bytes_used;
+  int exceeded;
+};
+
+/* Same as deterministic_fsm(), but once the DFA goes over budget it stops,
+ *  gives back whatever it can (all of it, on the heap) and returns NULL.
+ *  Either way, budget says how far it got.
+ */
+struct FSM *deterministic_fsm_within(struct FSM *ndfa, void **alphabet,
+    int num_symbols, struct DeterminizeBudget *budget);
+
+/* What a metastate for a set of states costs, going by what budgets count,
+ *  with its transitions on num_symbols symbols
+ */
+size_t metastate_size(struct StateArray *states, int num_symbols);
+
+/* Count a metastate against a budget. Returns 0 once it's over. */
+int spend_budget(struct DeterminizeBudget *budget, size_t bytes);
+
+/* Make the DFA state for a set of NFA states: accepting if any of them are,
+ *  and for all the patterns they are.
+ * Takes ownership of states; given an arena, it moves them into it.
+ */
+struct State *new_metastate(struct Arena *arena,
+    struct EpsilonClosures *closures, struct StateArray *states);
+
+/* Every pattern the accepting states in a set accept for, sorted, without
+ *  repeats. The array is malloc()ed, or NULL if there are none.
+ */
+int patterns_of(struct EpsilonClosures *closures, struct StateArray *states,
+    int **ref_patterns);
+
+/* Function used by deterministic_fsm() to build the DFA: works out every
+ *  transition out of one metastate, making (and adding to the DFA) any
+ *  metastates it leads to that don't exist yet.
+ */
+void build_dfa_from_metastate(struct FSM *dfa, struct EpsilonClosures *closures,
+    struct MetastateTable *table, struct State *metastate);
 
 int are_state_arrays_equal(struct StateArray *left, struct StateArray *right);
+unsigned long hash_state_array(struct StateArray *states);
+
+struct MetastateTable *new_metastate_table();
+void delete_metastate_table(struct MetastateTable *table);
+
+/* Returns NULL if there is no metastate for that set of states yet */
+struct State *find_metastate(struct MetastateTable *table,
+    struct StateArray *states);
+void insert_metastate(struct MetastateTable *table, struct State *metastate);
+
+/* Work out the epsilon closure of every state in a packed NFA */
+struct EpsilonClosures *compute_epsilon_closures(struct CompiledNFA *csr);
+void delete_epsilon_closures(struct EpsilonClosures *closures);
+
+/* An empty set of states, sized for the NFA the closures came from */
+struct StateArray *new_state_array(struct EpsilonClosures *closures);
+void delete_state_array(struct StateArray *states);
+
+/* Rebuild the states list of a set from its bitset */
+void fill_state_array(struct EpsilonClosures *closures,
+    struct StateArray *states);
+
+/* The epsilon closure of the NFA's start state */
+struct StateArray *start_states(struct EpsilonClosures *closures);
 
 /* Do the epsilon closure for a set of possible states */
-void epsilon_closure(struct State ***possible_states, int *num_possible_states);
+void epsilon_closure(struct EpsilonClosures *closures,
+    struct StateArray *states);
 
-struct StateArray *possible_states_from(struct StateArray *states, void *input);
+/* Where a set of states can go on a symbol, the symbol being its number in
+ *  the packed NFA (see compiled_symbol())
+ */
+struct StateArray *possible_states_from(struct EpsilonClosures *closures,
+    struct StateArray *states, int symbol);
 
 int add_if_not_present(void ***ref_array, int *size, void *item);
 
@@ -3,68 +3,344 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "fsm.h"
 #include "dot_output.h"
+#include "stats.h"
+
+/* How much output piles up before it's written */
+#define DOT_BUFFER_SIZE (1 << 16)
+
+/* Output on its way to the stream, a big piece at a time */
+struct DotBuffer
+{
+  FILE *stream;
+  char data[DOT_BUFFER_SIZE];
+  size_t length;
+};
+
+/* Which number each state of the FSM is. States usually know their own
+ *  index, but one that's in more than one FSM only knows the last one, so
+ *  then they're looked up by address instead.
+ */
+struct StateNumbers
+{
+  struct FSM *fsm;
+  int dense;
+
+  struct State **keys;
+  int *values;
+  unsigned long mask;
+};
+
+/* One transition out of a state: where it goes, which symbol it's on, and
+ *  where it came in the transition tree
+ */
+struct DotEdge
+{
+  int to;
+  int order;
+  void *symbol;
+};
+
+/* Every symbol's label, made once each, by symbol number */
+struct LabelCache
+{
+  char **labels;
+  int num_labels;
+  symbol_string_func symbol_string;
+};
+
+static void put_string(struct DotBuffer *buffer, const char *string);
+static void put_int(struct DotBuffer *buffer, int value);
+static void flush_buffer(struct DotBuffer *buffer);
+static void number_states(struct StateNumbers *numbers, struct FSM *fsm);
+static int state_number(struct StateNumbers *numbers, struct State *state);
+static unsigned long hash_pointer(struct State *state);
+static const char *symbol_label(struct LabelCache *cache, void *symbol);
+static void collect_edges(struct Transition *root,
+    struct StateNumbers *numbers, struct DotEdge **edges, int *num_edges,
+    int *capacity);
+static int compare_edges(const void *left, const void *right);
 
 void fprint_fsm(FILE *stream, struct FSM *fsm,
     symbol_string_func symbol_string, id_string_func id_string)
 {
+  struct DotBuffer *buffer = (struct DotBuffer *)
+    malloc( sizeof(struct DotBuffer) );
+  struct StateNumbers numbers;
+  struct LabelCache labels = { NULL, 0, symbol_string };
+  struct DotEdge *edges = NULL;
+  int capacity = 0, num_edges;
+
+  STATS_START(STATS_EMIT);
+
+  buffer->stream = stream;
+  buffer->length = 0;
+
+  number_states(&numbers, fsm);
+
   /* Generic stuff for all FSMs */
-  fprintf(stream, "digraph fsm\n{\n");
-  fprintf(stream, "rankdir=\"LR\"\n");
-  fprintf(stream, "edge [fontname=\"Verdana\"]\n");
-  fprintf(stream, "node [fontname=\"Verdana\"]\n");
-  fprintf(stream, "start [shape=\"plaintext\",label=\"start\"]\n");
+  put_string(buffer, "digraph fsm\n{\n");
+  put_string(buffer, "rankdir=\"LR\"\n");
+  put_string(buffer, "edge [fontname=\"Verdana\"]\n");
+  put_string(buffer, "node [fontname=\"Verdana\"]\n");
+  put_string(buffer, "start [shape=\"plaintext\",label=\"start\"]\n");
 
   /* Now let's get into specifics... */
-  int i, start = 0;
+  int i, j, start = 0;
 
   for(i = 0; i < fsm->num_states; i++)
   {
     char *s = id_string(fsm->states[i]->id);
-    fprintf(stream, "%i [shape=\"%s\",label=\"%s\"]\n",
-        i, (fsm->states[i]->accepting ? "doublecircle" : "circle"), s);
+    put_int(buffer, i);
+    put_string(buffer, fsm->states[i]->accepting ?
+        " [shape=\"doublecircle\",label=\"" : " [shape=\"circle\",label=\"");
+    put_string(buffer, s);
+    put_string(buffer, "\"]\n");
     free(s);
 
     if(fsm->states[i] == fsm->start_state)
       start = i;
   }
 
-  fprintf(stream, "start->%i\n", start);
+  put_string(buffer, "start->");
+  put_int(buffer, start);
+  put_string(buffer, "\n");
 
+  /* All the transitions from one state to another make one edge, labelled
+   *  with every symbol it's for, in order
+   */
   for(i = 0; i < fsm->num_states; i++)
   {
-    if(fsm->states[i]->transitions_tree != NULL)
-      fprint_transitions(stream, fsm->states[i]->transitions_tree, 
-          fsm, fsm->states[i], symbol_string);
+    if(fsm->states[i]->transitions_tree == NULL)
+      continue;
+
+    num_edges = 0;
+    collect_edges(fsm->states[i]->transitions_tree, &numbers, &edges,
+        &num_edges, &capacity);
+    qsort(edges, num_edges, sizeof(struct DotEdge), compare_edges);
+
+    for(j = 0; j < num_edges; j++)
+    {
+      if(j == 0 || edges[j].to != edges[j - 1].to)
+      {
+        put_int(buffer, i);
+        put_string(buffer, "->");
+        put_int(buffer, edges[j].to);
+        put_string(buffer, " [label=\"");
+      }
+      else
+        put_string(buffer, ",");
+
+      put_string(buffer, symbol_label(&labels, edges[j].symbol));
+
+      if(j == num_edges - 1 || edges[j].to != edges[j + 1].to)
+        put_string(buffer, "\"]\n");
+    }
+  }
+
+  put_string(buffer, "}\n");
+  flush_buffer(buffer);
+
+  for(i = 0; i < labels.num_labels; i++)
+    free(labels.labels[i]);
+
+  free(labels.labels);
+  free(edges);
+  free(numbers.keys);
+  free(numbers.values);
+  free(buffer);
+
+  STATS_STOP(STATS_EMIT);
+}
+
+static void put_string(struct DotBuffer *buffer, const char *string)
+{
+  size_t length = strlen(string);
+
+  if(buffer->length + length > DOT_BUFFER_SIZE)
+  {
+    flush_buffer(buffer);
+
+    /* Too big to ever fit, so it goes straight out */
+    if(length > DOT_BUFFER_SIZE)
+    {
+      fwrite(string, 1, length, buffer->stream);
+      return;
+    }
   }
 
-  fprintf(stream, "}\n");
+  memcpy(buffer->data + buffer->length, string, length);
+  buffer->length += length;
 }
 
-void fprint_transitions(FILE *stream, struct Transition *root,
-    struct FSM *fsm, struct State *from, symbol_string_func symbol_string)
+static void put_int(struct DotBuffer *buffer, int value)
 {
-  if(root->left != NULL)
-    fprint_transitions(stream, root->left, fsm, from, symbol_string);
+  char digits[16];
+  int length = 0;
+  unsigned int left = (value < 0) ? 0u - (unsigned int) value :
+    (unsigned int) value;
+
+  do
+  {
+    digits[sizeof(digits) - 2 - length++] = '0' + left % 10;
+    left /= 10;
+  } while(left);
+
+  if(value < 0)
+    digits[sizeof(digits) - 2 - length++] = '-';
+
+  digits[sizeof(digits) - 1] = '\0';
+  put_string(buffer, digits + sizeof(digits) - 1 - length);
+}
+
+static void flush_buffer(struct DotBuffer *buffer)
+{
+  fwrite(buffer->data, 1, buffer->length, buffer->stream);
+  buffer->length = 0;
+}
+
+static void number_states(struct StateNumbers *numbers, struct FSM *fsm)
+{
+  unsigned long size = 16, h;
+  int i;
+
+  numbers->fsm = fsm;
+  numbers->dense = 1;
+  numbers->keys = NULL;
+  numbers->values = NULL;
+
+  for(i = 0; i < fsm->num_states; i++)
+    if(fsm->states[i]->index != i)
+      numbers->dense = 0;
 
-  int i, j, from_index, to_index;
+  if(numbers->dense)
+    return;
+
+  /* Keep the table at most half full */
+  while(size < 2 * (unsigned long) fsm->num_states)
+    size *= 2;
+
+  numbers->mask = size - 1;
+  numbers->keys = (struct State **) calloc( size, sizeof(struct State *) );
+  numbers->values = (int *) malloc( size * sizeof(int) );
 
   for(i = 0; i < fsm->num_states; i++)
-    if(fsm->states[i] == from)
-      from_index = i;
+  {
+    h = hash_pointer(fsm->states[i]) & numbers->mask;
+
+    while(numbers->keys[h] != NULL && numbers->keys[h] != fsm->states[i])
+      h = (h + 1) & numbers->mask;
+
+    /* If a state's in there twice, it's the last one, as it always was */
+    numbers->keys[h] = fsm->states[i];
+    numbers->values[h] = i;
+  }
+}
+
+/* A state's number, or -1 if it isn't in the FSM */
+static int state_number(struct StateNumbers *numbers, struct State *state)
+{
+  if(numbers->dense)
+  {
+    int i = state->index;
+
+    if(i >= 0 && i < numbers->fsm->num_states &&
+        numbers->fsm->states[i] == state)
+      return i;
+
+    return -1;
+  }
+
+  unsigned long h = hash_pointer(state) & numbers->mask;
+
+  while(numbers->keys[h] != NULL)
+  {
+    if(numbers->keys[h] == state)
+      return numbers->values[h];
+
+    h = (h + 1) & numbers->mask;
+  }
+
+  return -1;
+}
+
+static unsigned long hash_pointer(struct State *state)
+{
+  unsigned long h = (unsigned long) state;
+
+  /* The low bits are mostly alignment, so mix the rest down into them */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static const char *symbol_label(struct LabelCache *cache, void *symbol)
+{
+  int id = SYMBOL_ID(symbol);
+
+  if(id >= cache->num_labels)
+  {
+    int size = (id + 1 > 2 * cache->num_labels) ?
+      id + 1 : 2 * cache->num_labels;
+
+    cache->labels = (char **) realloc(cache->labels, size * sizeof(char *));
+    memset(cache->labels + cache->num_labels, 0,
+        (size - cache->num_labels) * sizeof(char *));
+    cache->num_labels = size;
+  }
+
+  if(cache->labels[id] == NULL)
+    cache->labels[id] = cache->symbol_string(symbol);
+
+  return cache->labels[id];
+}
+
+/* Every transition in a tree, in order of symbol */
+static void collect_edges(struct Transition *root,
+    struct StateNumbers *numbers, struct DotEdge **edges, int *num_edges,
+    int *capacity)
+{
+  int i;
+
+  if(root->left != NULL)
+    collect_edges(root->left, numbers, edges, num_edges, capacity);
 
   for(i = 0; i < root->num_to; i++)
   {
-    for(j = 0; j < fsm->num_states; j++)
-      if(fsm->states[j] == root->to[i])
-        to_index = j;
+    int to = state_number(numbers, root->to[i]);
 
-    char *s = symbol_string(root->value);
-    fprintf(stream, "%i->%i [label=\"%s\"]\n", from_index, to_index, s);
-    free(s);
+    if(to < 0)
+      continue;
+
+    if(*num_edges == *capacity)
+    {
+      *capacity = *capacity ? 2 * *capacity : 16;
+      *edges = (struct DotEdge *) realloc(*edges,
+          *capacity * sizeof(struct DotEdge));
+    }
+
+    (*edges)[*num_edges].to = to;
+    (*edges)[*num_edges].order = *num_edges;
+    (*edges)[(*num_edges)++].symbol = root->value;
   }
 
   if(root->right != NULL)
-    fprint_transitions(stream, root->right, fsm, from, symbol_string);
+    collect_edges(root->right, numbers, edges, num_edges, capacity);
+}
+
+/* By where they go, and then in the order they came in */
+static int compare_edges(const void *left, const void *right)
+{
+  const struct DotEdge *l = (const struct DotEdge *) left;
+  const struct DotEdge *r = (const struct DotEdge *) right;
+
+  if(l->to != r->to)
+    return (l->to < r->to) ? -1 : 1;
+
+  return (l->order > r->order) - (l->order < r->order);
 }
@@ -11,10 +11,11 @@
 typedef char * (*symbol_string_func)(void *);
 typedef char * (*id_string_func)(void *);
 
+/* Write an FSM out for Graphviz. Transitions from one state to another are
+ *  drawn as a single edge, labelled with all of their symbols. Each symbol's
+ *  string is only asked for once.
+ */
 void fprint_fsm(FILE *stream, struct FSM *fsm,
     symbol_string_func symbol_string, id_string_func id_string);
 
-void fprint_transitions(FILE *stream, struct Transition *root,
-    struct FSM *fsm, struct State *from, symbol_string_func symbol_string);
-
 #endif
@@ -3,90 +3,320 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "fsm.h"
+#include "stats.h"
 
 void *EPSILON;
 
+static void release_fsm(struct FSM *fsm);
+static struct Transition *new_transition(struct Arena *arena,
+    struct State *to, void *input);
+static int append_transitions_to(struct State *to, struct Transition *root,
+    struct Transition ***ref_array, int array_size);
+static void start_predecessors(struct State *state);
+static void add_predecessor(struct State *to, struct State *from,
+    void *symbol);
+static void remove_predecessor(struct State *to, struct State *from,
+    void *symbol);
+static void index_transitions(struct FSM *fsm, struct State *from,
+    struct Transition *root);
+
+struct FSM *new_fsm(struct Arena *arena)
+{
+  struct FSM *fsm = (struct FSM *) arena_alloc(arena, sizeof(struct FSM));
+
+  fsm->states = NULL;
+  fsm->start_state = NULL;
+  fsm->num_states = 0;
+  fsm->arena = arena;
+  fsm->keeps_predecessors = 0;
+
+  return fsm;
+}
+
+void delete_fsm(struct FSM *fsm)
+{
+  int i;
+
+  if(fsm->arena != NULL)
+    return;
+
+  for(i = 0; i < fsm->num_states; i++)
+    delete_state(fsm->states[i]);
+
+  release_fsm(fsm);
+}
+
+/* Free the FSM itself and its states array, leaving the states be */
+static void release_fsm(struct FSM *fsm)
+{
+  if(fsm->arena == NULL)
+  {
+    free(fsm->states);
+    free(fsm);
+  }
+}
+
 void add_state(struct FSM *fsm, struct State *state)
 {
-  if(fsm->num_states > 0)
-    fsm->states = (struct State **) realloc(fsm->states,
-        ++fsm->num_states * sizeof(struct State *));
-  else
-    fsm->states = (struct State **)
-      malloc(++fsm->num_states * sizeof(struct State *));
+  fsm->states = (struct State **) arena_grow(fsm->arena, fsm->states,
+      fsm->num_states, sizeof(struct State *));
 
-  fsm->states[fsm->num_states-1] = state;
+  fsm->states[fsm->num_states++] = state;
+  state->index = fsm->num_states-1;
+
+  if(fsm->keeps_predecessors && state->predecessors == NULL)
+    start_predecessors(state);
 }
 
 void remove_state(struct FSM *fsm, struct State *state)
 {
-  int i, found_yet = 0, j;
+  int i, j;
+
+  /* Its index says where it is, unless it's been added to another FSM */
+  if(state->index >= 0 && state->index < fsm->num_states &&
+      fsm->states[state->index] == state)
+    i = state->index;
+  else
+    for(i = 0; i < fsm->num_states && fsm->states[i] != state; i++);
+
+  if(i == fsm->num_states)
+    return;
 
   /* We want to shift everything down in the array, then resize it.
    * Don't worry, we don't have to free() the state, we just have to
    *  remove it from the FSM.
    */
-  for(i = 0; i < fsm->num_states - 1; i++)
-    if(found_yet || (fsm->states[i] == state && (found_yet = 1)))
-      fsm->states[i] = fsm->states[i+1];
+  for(; i < fsm->num_states - 1; i++)
+  {
+    fsm->states[i] = fsm->states[i+1];
+    fsm->states[i]->index = i;
+  }
 
-  if(found_yet || fsm->states[fsm->num_states - 1] == state)
-    fsm->states = (struct State **) realloc(fsm->states,
-        --fsm->num_states * sizeof(struct State *));
-  else
-    return;
+  /* The array keeps its size; it only ever grows (see arena_grow()) */
+  fsm->num_states--;
 
   /* Now we have to get rid of the transitions that lead to this state */
 
+  if(state->predecessors != NULL)
+  {
+    /* Deleting a transition takes it off the end of the list, which is
+     *  where it's looked for first
+     */
+    while(state->num_predecessors > 0)
+    {
+      struct Predecessor last =
+        state->predecessors[state->num_predecessors - 1];
+
+      delete_transition(last.from, state, last.symbol);
+
+      /* It should always have been there, but if not, don't go round
+       *  forever
+       */
+      if(state->num_predecessors > 0 &&
+          state->predecessors[state->num_predecessors - 1].from ==
+          last.from &&
+          state->predecessors[state->num_predecessors - 1].symbol ==
+          last.symbol)
+        state->num_predecessors--;
+    }
+
+    return;
+  }
+
   /* Loop through each state */
   for(i = 0; i < fsm->num_states; i++)
   {
-    struct State *current_state = fsm->states[i];
-    struct Transition ***ref_transitions;
+    struct Transition **transitions = NULL;
     int num_transitions;
 
-    ref_transitions = (struct Transition ***)
-      malloc( sizeof(struct Transition ***) );
-
     /* Figure out which transitions this state has that point to the state
      *  that we want to remove.
      */
     num_transitions = transitions_from_to(fsm->states[i], state,
-        ref_transitions);
+        &transitions);
+
+    /* Deleting one can shuffle the others around the tree, so note down
+     *  their symbols before deleting any
+     */
+    void **symbols = (void **) malloc( num_transitions * sizeof(void *) );
+
+    for(j = 0; j < num_transitions; j++)
+      symbols[j] = transitions[j]->value;
 
     /* Delete all of those */
     for(j = 0; j < num_transitions; j++)
-      delete_transition(fsm->states[i], state, (*ref_transitions)[j]->value);
+      delete_transition(fsm->states[i], state, symbols[j]);
     
-    free(ref_transitions);
+    free(symbols);
+    free(transitions);
+  }
+}
+
+void index_predecessors(struct FSM *fsm)
+{
+  int i;
+
+  fsm->keeps_predecessors = 1;
+
+  for(i = 0; i < fsm->num_states; i++)
+  {
+    fsm->states[i]->index = i;
+
+    if(fsm->states[i]->predecessors == NULL)
+      start_predecessors(fsm->states[i]);
+    else
+      fsm->states[i]->num_predecessors = 0;
   }
+
+  for(i = 0; i < fsm->num_states; i++)
+    if(fsm->states[i]->transitions_tree != NULL)
+      index_transitions(fsm, fsm->states[i],
+          fsm->states[i]->transitions_tree);
+}
+
+void redirect_transitions(struct State *from, struct State *to)
+{
+  while(from->num_predecessors > 0)
+  {
+    struct Predecessor last = from->predecessors[from->num_predecessors - 1];
+
+    delete_transition(last.from, from, last.symbol);
+
+    /* As in remove_state() */
+    if(from->num_predecessors > 0 &&
+        from->predecessors[from->num_predecessors - 1].from == last.from &&
+        from->predecessors[from->num_predecessors - 1].symbol == last.symbol)
+      from->num_predecessors--;
+
+    add_transition(last.from, to, last.symbol);
+  }
+}
+
+/* Add every transition in a tree to the predecessors of where it goes, if
+ *  that's in the FSM
+ */
+static void index_transitions(struct FSM *fsm, struct State *from,
+    struct Transition *root)
+{
+  int i;
+
+  if(root->left != NULL)
+    index_transitions(fsm, from, root->left);
+
+  for(i = 0; i < root->num_to; i++)
+  {
+    struct State *to = root->to[i];
+
+    if(to->index >= 0 && to->index < fsm->num_states &&
+        fsm->states[to->index] == to)
+      add_predecessor(to, from, root->value);
+  }
+
+  if(root->right != NULL)
+    index_transitions(fsm, from, root->right);
+}
+
+static void start_predecessors(struct State *state)
+{
+  state->predecessors_capacity = 4;
+  state->num_predecessors = 0;
+  state->predecessors = (struct Predecessor *) arena_alloc(state->arena,
+      state->predecessors_capacity * sizeof(struct Predecessor));
+}
+
+static void add_predecessor(struct State *to, struct State *from,
+    void *symbol)
+{
+  /* Doubling, so that states with a lot of transitions to them don't cost a
+   *  copy apiece
+   */
+  if(to->num_predecessors == to->predecessors_capacity)
+  {
+    struct Predecessor *grown = (struct Predecessor *) arena_alloc(to->arena,
+        2 * to->predecessors_capacity * sizeof(struct Predecessor));
+
+    memcpy(grown, to->predecessors,
+        to->num_predecessors * sizeof(struct Predecessor));
+    arena_free(to->arena, to->predecessors);
+
+    to->predecessors = grown;
+    to->predecessors_capacity *= 2;
+  }
+
+  to->predecessors[to->num_predecessors].from = from;
+  to->predecessors[to->num_predecessors++].symbol = symbol;
+}
+
+/* The one most recently added is looked for first, and the last one takes
+ *  the place of whichever goes
+ */
+static void remove_predecessor(struct State *to, struct State *from,
+    void *symbol)
+{
+  int i;
+
+  for(i = to->num_predecessors - 1; i >= 0; i--)
+    if(to->predecessors[i].from == from && to->predecessors[i].symbol == symbol)
+    {
+      to->predecessors[i] = to->predecessors[--to->num_predecessors];
+      return;
+    }
 }
 
                              /* -------------- */
 
-struct State *new_state(void *id, comparator cmp)
+struct State *new_state(struct Arena *arena, void *id)
 {
   struct State *state;
 
-  state = (struct State *) malloc( sizeof(struct State) );
+  state = (struct State *) arena_alloc( arena, sizeof(struct State) );
   
   state->id = id;
-  state->cmp = cmp;
+  state->arena = arena;
   state->transitions_tree = NULL;
   state->accepting = 0;
+  state->patterns = NULL;
+  state->num_patterns = 0;
+  state->index = -1;
+  state->predecessors = NULL;
+  state->num_predecessors = 0;
+  state->predecessors_capacity = 0;
+
+  STATS_COUNT(states_created);
 
   return state;
 }
 
 void delete_state(struct State *state)
 {
+  if(state->arena != NULL)
+    return;
+
   if(state->transitions_tree != NULL)
     delete_all_transitions(state->transitions_tree);
 
+  free(state->patterns);
+  free(state->predecessors);
   free(state);
 }
 
+void set_patterns(struct State *state, int *patterns, int num_patterns)
+{
+  arena_free(state->arena, state->patterns);
+
+  state->num_patterns = num_patterns;
+  state->patterns = NULL;
+
+  if(num_patterns)
+  {
+    state->patterns = (int *)
+      arena_alloc(state->arena, num_patterns * sizeof(int));
+    memcpy(state->patterns, patterns, num_patterns * sizeof(int));
+  }
+}
+
 void delete_all_transitions(struct Transition *root)
 {
   if(root->left != NULL)
@@ -95,31 +325,39 @@ void delete_all_transitions(struct Transition *root)
   if(root->right != NULL)
     delete_all_transitions(root->right);
 
+  free(root->to);
   free(root);
 }
 
+static struct Transition *new_transition(struct Arena *arena,
+    struct State *to, void *input)
+{
+  struct Transition *t = (struct Transition *)
+    arena_alloc( arena, sizeof(struct Transition) );
+
+  t->value = input;
+  t->to = (struct State **) arena_grow(arena, NULL, 0, sizeof(struct State *));
+  t->num_to = 1;
+  t->to[0] = to;
+  t->left = NULL;
+  t->right = NULL;
+
+  STATS_COUNT(transitions_created);
+
+  return t;
+}
+
 void add_transition(struct State *from, struct State *to, void *input)
 {
   struct Transition *cur = from->transitions_tree;
+  int added = 1;
   
   if(cur == NULL)
-  {
-    struct Transition *t = (struct Transition *)
-      malloc( sizeof(struct Transition) );
-
-    t->value = input;
-    t->to = (struct State **) malloc( 1 * sizeof(struct State *) );
-    t->num_to = 1;
-    t->left = NULL;
-    t->right = NULL;
-    t->to[0] = to;
-
-    from->transitions_tree = t;
-  }
+    from->transitions_tree = new_transition(from->arena, to, input);
 
   while(cur != NULL)
   {
-    int comparison = (*from->cmp)(input, cur->value);
+    int comparison = compare_symbols(input, cur->value);
     if(comparison < 0)
     {
       /* less than cur: Go to left child */
@@ -127,18 +365,7 @@ void add_transition(struct State *from, struct State *to, void *input)
         cur = cur->left;
       else
       {
-        struct Transition *t = (struct Transition *)
-          malloc( sizeof(struct Transition) );
-
-        t->value = input;
-        t->to = (struct State **) malloc( 1 * sizeof(struct State *) );
-        t->num_to = 1;
-        t->to[0] = to;
-        t->left = NULL;
-        t->right = NULL;
-
-        cur->left = t; 
-
+        cur->left = new_transition(from->arena, to, input);
         cur = NULL;
       }
     }
@@ -149,18 +376,7 @@ void add_transition(struct State *from, struct State *to, void *input)
         cur = cur->right;
       else
       {
-        struct Transition *t = (struct Transition *)
-          malloc( sizeof(struct Transition) );
-
-        t->value = input;
-        t->to = (struct State **) malloc( 1 * sizeof(struct State *) );
-        t->num_to = 1;
-        t->to[0] = to;
-        t->left = NULL;
-        t->right = NULL;
-
-        cur->right = t;
-
+        cur->right = new_transition(from->arena, to, input);
         cur = NULL;
       }
     }
@@ -179,15 +395,21 @@ void add_transition(struct State *from, struct State *to, void *input)
       
       if(!found)
       {
-        t->to = (struct State **) realloc(t->to,
-            ++t->num_to * sizeof(struct State *));
+        t->to = (struct State **) arena_grow(from->arena, t->to, t->num_to,
+            sizeof(struct State *));
 
-        t->to[t->num_to - 1] = to;
+        t->to[t->num_to++] = to;
+        STATS_COUNT(transitions_created);
       }
+      else
+        added = 0;
 
       cur = NULL;
     }
   }
+
+  if(added && to->predecessors != NULL)
+    add_predecessor(to, from, input);
 }
 
 void delete_transition(struct State *from, struct State *to, void *input)
@@ -196,27 +418,30 @@ void delete_transition(struct State *from, struct State *to, void *input)
   int comparison;
 
   /* Gotta make sure there are transitions from this state to begin with... */
-  if(cur == NULL)
+  if(*cur == NULL)
     return;
 
   do
   {
     /* We now gotta find the (struct Transition *) with the right input...
-     * Remember, the transition bst is organized by input symbol
+     * Remember, the transition bst is organized by input symbol.
+     * cur points at the link to the node rather than being it, so that the
+     *  node can be unlinked from its parent; moving along must move cur, not
+     *  rewrite the link.
      */
-    comparison = (*from->cmp)((*cur)->value, input);
+    comparison = compare_symbols(input, (*cur)->value);
 
     if(comparison < 0)
       /* Look to the left */
       if((*cur)->left != NULL)
-        (*cur) = (*cur)->left;
+        cur = &(*cur)->left;
       else
         return;
 
     else if(comparison > 0)
       /* Look to the right */
       if((*cur)->right != NULL)
-        (*cur) = (*cur)->right;
+        cur = &(*cur)->right;
       else
         return;
   } while(comparison != 0);
@@ -231,38 +456,43 @@ void delete_transition(struct State *from, struct State *to, void *input)
       if((*cur)->to[i] == to)
         found = 1;
 
+    /* The array keeps its size; it only ever grows (see arena_grow()) */
     if(found)
       if(i == (*cur)->num_to - 1)
-        (*cur)->to = (struct State **) realloc((*cur)->to,
-            --(*cur)->num_to * sizeof(struct State *));
+        (*cur)->num_to--;
       else
         (*cur)->to[i] = (*cur)->to[i+1];
   }
 
-  /* Now it should have successfully been removed from that array, and that
-   * array has been downsized.
+  if(found && to->predecessors != NULL)
+    remove_predecessor(to, from, input);
+
+  /* Now it should have successfully been removed from that array.
    * But that might leave us with an empty array. If that's the case, let's
    * remove the struct Transition * from the BST.
    */
   if(!(*cur)->num_to)
-    delete_struct_transition(cur);
+  {
+    arena_free(from->arena, (*cur)->to);
+    delete_struct_transition(from->arena, cur);
+  }
 }
 
-void delete_struct_transition(struct Transition **node)
+void delete_struct_transition(struct Arena *arena, struct Transition **node)
 {
   if((*node)->left == NULL)
   {
     struct Transition *temp;
     temp = *node;
     *node = (*node)->right;
-    free(temp);
+    arena_free(arena, temp);
   }
   else if((*node)->right == NULL)
   {
     struct Transition *temp;
     temp = *node;
     *node = (*node)->left;
-    free(temp);
+    arena_free(arena, temp);
   }
   else
   {
@@ -270,14 +500,14 @@ void delete_struct_transition(struct Transition **node)
 
     while((*pred)->right != NULL)
     {
-      (*pred) = (*pred)->right;
+      pred = &(*pred)->right;
     }
 
     (*node)->value = (*pred)->value;
     (*node)->to = (*pred)->to;
     (*node)->num_to = (*pred)->num_to;
 
-    delete_struct_transition(pred);
+    delete_struct_transition(arena, pred);
   }
 }
 
@@ -296,7 +526,7 @@ struct Transition *transition_from_with_input(struct State *from, void *input)
 
   while(cur != NULL)
   {
-    int comparison = (*from->cmp)(input, cur->value);
+    int comparison = compare_symbols(input, cur->value);
     if(comparison < 0)
     {
       if(cur->left != NULL)
@@ -321,15 +551,23 @@ struct Transition *transition_from_with_input(struct State *from, void *input)
 int build_array_of_transitions_to(struct State *to, struct Transition *root,
     struct Transition ***ref_array)
 {
-  int array_size = 0;
+  return append_transitions_to(to, root, ref_array, 0);
+}
 
+/* Each subtree has to add on to what's in the array already, rather than
+ *  counting from zero
+ */
+static int append_transitions_to(struct State *to, struct Transition *root,
+    struct Transition ***ref_array, int array_size)
+{
   if(root->left != NULL)
-    array_size += build_array_of_transitions_to(to, root->left, ref_array);
+    array_size = append_transitions_to(to, root->left, ref_array, array_size);
 
   if(root->right != NULL)
-    array_size += build_array_of_transitions_to(to, root->right, ref_array);
+    array_size = append_transitions_to(to, root->right, ref_array,
+        array_size);
 
-  int i, num_to;
+  int i;
 
   for(i = 0; i < root->num_to; i++)
   {
@@ -346,12 +584,12 @@ int build_array_of_transitions_to(struct State *to, struct Transition *root,
 
 struct FSM *fsmunion(struct FSM *left, struct FSM *right)
 {
-  struct FSM *fsm = (struct FSM *) malloc(sizeof(struct FSM));
+  STATS_START(STATS_CONSTRUCT);
 
-  fsm->num_states = 0;
+  struct FSM *fsm = new_fsm(left->arena);
 
-  struct State *start = new_state(NULL, left->start_state->cmp);
-  struct State *end = new_state(NULL, left->start_state->cmp);
+  struct State *start = new_state(fsm->arena, NULL);
+  struct State *end = new_state(fsm->arena, NULL);
 
   add_state(fsm, start);
 
@@ -385,14 +623,19 @@ struct FSM *fsmunion(struct FSM *left, struct FSM *right)
 
   end->accepting = 1;
 
+  release_fsm(left);
+  release_fsm(right);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
   return fsm;
 }
 
 struct FSM *fsmcat(struct FSM *left, struct FSM *right)
 {
-  struct FSM *fsm = (struct FSM *) malloc(sizeof(struct FSM));
+  STATS_START(STATS_CONSTRUCT);
 
-  fsm->num_states = 0;
+  struct FSM *fsm = new_fsm(left->arena);
 
   fsm->start_state = left->start_state;
 
@@ -410,16 +653,22 @@ struct FSM *fsmcat(struct FSM *left, struct FSM *right)
   for(i = 0; i < right->num_states; i++)
     add_state(fsm, right->states[i]);
 
+  release_fsm(left);
+  release_fsm(right);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
   return fsm;
 }
 
 struct FSM *fsmclosure(struct FSM *left)
 {
-  struct FSM *fsm = (struct FSM *) malloc(sizeof(struct FSM));
-  fsm->num_states = 0;
+  STATS_START(STATS_CONSTRUCT);
+
+  struct FSM *fsm = new_fsm(left->arena);
 
-  struct State *start = new_state(NULL, left->start_state->cmp);
-  struct State *end = new_state(NULL, left->start_state->cmp);
+  struct State *start = new_state(fsm->arena, NULL);
+  struct State *end = new_state(fsm->arena, NULL);
 
   add_state(fsm, start);
 
@@ -444,6 +693,186 @@ struct FSM *fsmclosure(struct FSM *left)
   end->accepting = 1;
   add_state(fsm, end);
 
+  release_fsm(left);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
   return fsm;
 }
 
+
+void label_fsm(struct FSM *fsm, int pattern)
+{
+  int i;
+
+  for(i = 0; i < fsm->num_states; i++)
+    if(fsm->states[i]->accepting)
+      set_patterns(fsm->states[i], &pattern, 1);
+}
+
+struct FSM *fsmunion_patterns(struct FSM *left, struct FSM *right)
+{
+  STATS_START(STATS_CONSTRUCT);
+
+  struct FSM *fsm = new_fsm(left->arena);
+
+  struct State *start = new_state(fsm->arena, NULL);
+
+  add_state(fsm, start);
+
+  fsm->start_state = start;
+
+  add_transition(start, left->start_state, EPSILON);
+  add_transition(start, right->start_state, EPSILON);
+
+  int i;
+  for(i = 0; i < left->num_states; i++)
+    add_state(fsm, left->states[i]);
+
+  for(i = 0; i < right->num_states; i++)
+    add_state(fsm, right->states[i]);
+
+  release_fsm(left);
+  release_fsm(right);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
+  return fsm;
+}
+
+
+/*
+ * Glushkov (position) automata: one state per symbol in the regexp, plus a
+ *  start state, and no epsilon transitions. Every transition into a state is
+ *  on that state's symbol, and nothing goes back into the start state, so
+ *  gluing two of them together is just a matter of copying what the start
+ *  state of one does onto the states of the other.
+ */
+
+static void copy_transitions(struct State *from, struct Transition *root);
+static void merge_patterns(struct State *into, struct State *from);
+
+struct FSM *glushkov_union(struct FSM *left, struct FSM *right)
+{
+  STATS_START(STATS_CONSTRUCT);
+
+  struct State *start = left->start_state;
+  struct State *other = right->start_state;
+
+  /* The two start states become one */
+  if(other->transitions_tree != NULL)
+    copy_transitions(start, other->transitions_tree);
+
+  if(other->accepting)
+  {
+    if(start->accepting)
+      merge_patterns(start, other);
+    else
+      set_patterns(start, other->patterns, other->num_patterns);
+
+    start->accepting = 1;
+  }
+
+  int i;
+  for(i = 0; i < right->num_states; i++)
+    if(right->states[i] != other)
+      add_state(left, right->states[i]);
+
+  delete_state(other);
+  release_fsm(right);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
+  return left;
+}
+
+struct FSM *glushkov_cat(struct FSM *left, struct FSM *right)
+{
+  STATS_START(STATS_CONSTRUCT);
+
+  struct State *other = right->start_state;
+
+  /* Wherever the left side could have finished, the right side can start,
+   *  and it's only finished there if the right side can be empty
+   */
+  int i;
+  for(i = 0; i < left->num_states; i++)
+    if(left->states[i]->accepting)
+    {
+      if(other->transitions_tree != NULL)
+        copy_transitions(left->states[i], other->transitions_tree);
+
+      left->states[i]->accepting = other->accepting;
+    }
+
+  for(i = 0; i < right->num_states; i++)
+    if(right->states[i] != other)
+      add_state(left, right->states[i]);
+
+  delete_state(other);
+  release_fsm(right);
+
+  STATS_STOP(STATS_CONSTRUCT);
+
+  return left;
+}
+
+struct FSM *glushkov_closure(struct FSM *left)
+{
+  STATS_START(STATS_CONSTRUCT);
+
+  struct State *start = left->start_state;
+
+  /* Having finished, it can go round again */
+  int i;
+  for(i = 0; i < left->num_states; i++)
+    if(left->states[i]->accepting && left->states[i] != start &&
+        start->transitions_tree != NULL)
+      copy_transitions(left->states[i], start->transitions_tree);
+
+  start->accepting = 1;
+
+  STATS_STOP(STATS_CONSTRUCT);
+
+  return left;
+}
+
+/* Give a state every transition in a tree, to wherever they go */
+static void copy_transitions(struct State *from, struct Transition *root)
+{
+  int i;
+
+  if(root->left != NULL)
+    copy_transitions(from, root->left);
+
+  for(i = 0; i < root->num_to; i++)
+    add_transition(from, root->to[i], root->value);
+
+  if(root->right != NULL)
+    copy_transitions(from, root->right);
+}
+
+/* Add the patterns one accepting state is for to another's, kept in order */
+static void merge_patterns(struct State *into, struct State *from)
+{
+  int *merged = (int *)
+    malloc( (into->num_patterns + from->num_patterns + 1) * sizeof(int) );
+  int i = 0, j = 0, count = 0;
+
+  while(i < into->num_patterns || j < from->num_patterns)
+  {
+    int next;
+
+    if(j == from->num_patterns ||
+        (i < into->num_patterns && into->patterns[i] <= from->patterns[j]))
+      next = into->patterns[i++];
+    else
+      next = from->patterns[j++];
+
+    if(count == 0 || merged[count - 1] != next)
+      merged[count++] = next;
+  }
+
+  set_patterns(into, merged, count);
+  free(merged);
+}
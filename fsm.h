@@ -1,39 +1,70 @@
 #ifndef __FSM_H__
 #define __FSM_H__
 
-
-/* N.B. States are currently responsible for defining in essence a possible
- *  universe for the inputs on that state. It might make sense for a FSM to
- *  define its own universe instead.
- */
+#include "arena.h"
+#include "symbol.h"
 
 struct FSM
 {
   struct State **states;
   struct State *start_state;
   int num_states;
+
+  /* Where the FSM, its states array and any states it makes come from, or
+   *  NULL for the heap
+   */
+  struct Arena *arena;
+
+  /* Whether its states keep track of their predecessors (see
+   *  index_predecessors())
+   */
+  int keeps_predecessors;
 };
 
+/* An FSM with no states yet */
+struct FSM *new_fsm(struct Arena *arena);
+
+/* Free an FSM along with its states and their transitions, but not their
+ *  ids or symbols. Nothing to do if it's in an arena: delete the arena.
+ */
+void delete_fsm(struct FSM *fsm);
+
+/* Add a state to the end of an FSM. If the FSM keeps predecessors, so does
+ *  the state from then on; it's taken to have none yet if it didn't before.
+ */
 void add_state(struct FSM *fsm, struct State *state);
+
+/* Take a state out of an FSM, along with every transition to it, keeping
+ *  the rest in order. The state itself, and its own transitions, are left
+ *  be. With predecessors kept, this only touches the transitions to it;
+ *  otherwise every state in the FSM has to be searched for them.
+ */
 void remove_state(struct FSM *fsm, struct State *state);
 
+/* Start keeping track of where the transitions to each state of an FSM
+ *  come from, so that states can be taken out and transitions moved in time
+ *  that goes with how many there are, rather than the size of the FSM. From
+ *  then on, add_transition() and delete_transition() keep it up to date.
+ * Calling it again (say, after changing transitions by hand) rebuilds it.
+ */
+void index_predecessors(struct FSM *fsm);
+
+/* Move every transition that goes to one state onto another instead. Only
+ *  for states that keep their predecessors.
+ */
+void redirect_transitions(struct State *from, struct State *to);
+
 /*
- * Compares two values:
- *
- *   Return Value | Condition
- *   -------------+---------------
- *        -1      | left < right
- *   -------------+---------------
- *         0      | left == right
- *   -------------+---------------
- *         1      | left > right
- *   -------------+---------------
+ * Maps a transition symbol to the range of input bytes it stands for, low
+ *  up to high (the same byte twice for a single one).
+ * Returns 0 for EPSILON or for anything that isn't on bytes.
  */
-typedef int (*comparator)(void *, void *);
+typedef int (*symbol_bytes_func)(void *symbol, int *low, int *high);
 
 
 /*
- * Transition acts sort of like a binary search tree.
+ * Transition acts sort of like a binary search tree, ordered by symbol (see
+ *  symbol.h).
  */
 struct Transition
 {
@@ -46,13 +77,41 @@ struct Transition
 };
 
 
+/* One transition to a state: where it's from, and what it's on */
+struct Predecessor
+{
+  struct State *from;
+  void *symbol;
+};
+
 struct State
 {
   void *id;
   struct Transition *transitions_tree;
   int accepting;
 
-  comparator cmp;
+  /* For an accepting state, which patterns it accepts for, in increasing
+   *  order. Only set for FSMs whose patterns have been labelled (see
+   *  label_fsm()), and the DFAs made from them.
+   */
+  int *patterns;
+  int num_patterns;
+
+  /* Position of this state in the states array of the FSM it was last added
+   *  to. Kept up to date by add_state() and remove_state(), so it can be used
+   *  as a dense index instead of searching the array.
+   */
+  int index;
+
+  /* Every transition to this state, in no particular order, if the FSM it's
+   *  in keeps predecessors; otherwise NULL. These come out of its arena too.
+   */
+  struct Predecessor *predecessors;
+  int num_predecessors;
+  int predecessors_capacity;
+
+  /* Where its transitions get allocated from, or NULL for the heap */
+  struct Arena *arena;
 };
 
 
@@ -60,14 +119,24 @@ struct State
  * Create a new state with a pointer passed as a label/id.
  * This might be a (char *), but theoretically it can be anything,
  *   allowing for potential for easier lookup of state by id.
+ * The state and its transitions are allocated from arena (NULL for the heap).
+ */
+struct State *new_state(struct Arena *arena, void *id);
+
+/* Free a state on the heap and its transitions. States it goes to that keep
+ *  predecessors still list it afterwards, so unless they're going too (or
+ *  the index is about to be rebuilt), delete its transitions first.
  */
-struct State *new_state(void *id, comparator cmp);
 void delete_state(struct State *state);
 
+/* Give a state a copy of a sorted list of pattern ids */
+void set_patterns(struct State *state, int *patterns, int num_patterns);
+
 void add_transition(struct State *from, struct State *to, void *input);
 void delete_transition(struct State *from, struct State *to, void *input);
 
-void delete_struct_transition(struct Transition **t);
+/* Unlink a transition from the tree it's in; arena is where it came from */
+void delete_struct_transition(struct Arena *arena, struct Transition **t);
 
 void delete_all_transitions(struct Transition *root);
 
@@ -79,8 +148,35 @@ struct Transition *transition_from_with_input(struct State *from, void *input);
 int build_array_of_transitions_to(struct State *to, struct Transition *root,
     struct Transition ***ref_array);
 
+/* These take over their arguments' states and release what's left of the
+ *  arguments themselves, so those mustn't be used (or freed) afterwards.
+ *  The result is in the left argument's arena.
+ */
 struct FSM *fsmunion(struct FSM *left, struct FSM *right);
 struct FSM *fsmcat(struct FSM *left, struct FSM *right);
 struct FSM *fsmclosure(struct FSM *left);
 
+/* Label every accepting state of an FSM as accepting for one pattern */
+void label_fsm(struct FSM *fsm, int pattern);
+
+/* Like fsmunion(), but the accepting states of both sides stay accepting, so
+ *  they keep whatever patterns they're labelled with. Putting a lot of
+ *  labelled FSMs together with this makes one automaton that tells which of
+ *  them matched.
+ */
+struct FSM *fsmunion_patterns(struct FSM *left, struct FSM *right);
+
+/* The same three, for Glushkov automata, which have a state for each symbol
+ *  (and one to start in) and no epsilon transitions at all: about half the
+ *  states Thompson's construction above makes, and no epsilon closures to
+ *  work out. They only work on FSMs made by them, out of ones with a start
+ *  state that goes straight to an accepting state (as the lexer makes).
+ *  Like those, they take over their arguments; the result is the left one.
+ * Accepting states stay accepting through glushkov_union(), keeping their
+ *  patterns, so it does for fsmunion_patterns() too.
+ */
+struct FSM *glushkov_union(struct FSM *left, struct FSM *right);
+struct FSM *glushkov_cat(struct FSM *left, struct FSM *right);
+struct FSM *glushkov_closure(struct FSM *left);
+
 #endif
@@ -0,0 +1,259 @@
+/*
+ * lazy_dfa.c | DFAs built on demand from an NFA, with a bounded state cache
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "nfa_csr.h"
+#include "lazy_dfa.h"
+
+static struct LazyState *intern_lazy_state(struct LazyDFA *lazy,
+    struct StateArray *states);
+static size_t lazy_state_size(struct LazyDFA *lazy,
+    struct StateArray *states);
+
+struct LazyDFA *new_lazy_dfa(struct FSM *nfa, void **alphabet,
+    int num_symbols, symbol_bytes_func symbol_bytes, size_t memory_budget)
+{
+  struct LazyDFA *lazy = (struct LazyDFA *) malloc( sizeof(struct LazyDFA) );
+  int i;
+
+  lazy->nfa = nfa;
+  lazy->csr = compile_nfa(nfa, alphabet, num_symbols);
+  lazy->closures = compute_epsilon_closures(lazy->csr);
+
+  for(i = 0; i < 256; i++)
+    lazy->classes[i] = lazy->csr->num_classes;
+
+  /* Symbols that aren't on any transition go nowhere, like bytes that
+   *  aren't symbols, but they can share bytes with ones that are
+   */
+  char *on_edge = (char *) calloc( lazy->csr->num_symbols + 1, sizeof(char) );
+
+  for(i = 0; i < lazy->csr->edge_start[lazy->csr->num_states]; i++)
+    on_edge[lazy->csr->edges[i].symbol] = 1;
+
+  for(i = 0; i < lazy->csr->num_symbols; i++)
+  {
+    int low, high, b;
+
+    if(on_edge[i] &&
+        symbol_bytes(lazy->csr->symbols[i], &low, &high) && low >= 0 &&
+        high < 256)
+      for(b = low; b <= high; b++)
+        lazy->classes[b] = lazy->csr->symbol_class[i];
+  }
+
+  free(on_edge);
+
+  lazy->num_buckets = 64;
+  lazy->num_states = 0;
+  lazy->buckets = (struct LazyState **)
+    calloc( lazy->num_buckets, sizeof(struct LazyState *) );
+
+  lazy->start = NULL;
+  lazy->unanchored = 0;
+  lazy->memory_used = lazy->num_buckets * sizeof(struct LazyState *);
+  lazy->memory_budget = memory_budget;
+  lazy->num_flushes = 0;
+
+  return lazy;
+}
+
+void delete_lazy_dfa(struct LazyDFA *lazy)
+{
+  flush_lazy_dfa(lazy);
+
+  free(lazy->buckets);
+  delete_epsilon_closures(lazy->closures);
+  delete_compiled_nfa(lazy->csr);
+  free(lazy);
+}
+
+void flush_lazy_dfa(struct LazyDFA *lazy)
+{
+  int i;
+
+  for(i = 0; i < lazy->num_buckets; i++)
+    if(lazy->buckets[i] != NULL)
+    {
+      delete_state_array(lazy->buckets[i]->states);
+      free(lazy->buckets[i]->patterns);
+      free(lazy->buckets[i]);
+      lazy->buckets[i] = NULL;
+    }
+
+  lazy->num_states = 0;
+  lazy->start = NULL;
+  lazy->memory_used = lazy->num_buckets * sizeof(struct LazyState *);
+}
+
+struct LazyState *lazy_dfa_start(struct LazyDFA *lazy)
+{
+  if(lazy->start == NULL)
+    lazy->start = intern_lazy_state(lazy, start_states(lazy->closures));
+
+  return lazy->start;
+}
+
+struct LazyState *lazy_dfa_step(struct LazyDFA *lazy, struct LazyState *from,
+    unsigned char byte)
+{
+  int class = lazy->classes[byte], i;
+  struct LazyState *to = from->next[class];
+  struct StateArray *states;
+
+  if(to != NULL)
+    return to;
+
+  /* Bytes that aren't in the alphabet lead nowhere */
+  if(class == lazy->csr->num_classes)
+    states = new_state_array(lazy->closures);
+  else
+    states = possible_states_from(lazy->closures, from->states,
+        lazy->csr->class_symbol[class]);
+
+  if(lazy->unanchored)
+  {
+    /* A match could begin at the next byte too */
+    struct StateArray *restart = start_states(lazy->closures);
+
+    for(i = 0; i < states->num_words; i++)
+      states->bits[i] |= restart->bits[i];
+
+    fill_state_array(lazy->closures, states);
+    delete_state_array(restart);
+  }
+
+  int flushes = lazy->num_flushes;
+
+  to = intern_lazy_state(lazy, states);
+
+  /* If making it flushed the cache, from is gone, so there's nothing to
+   *  remember the transitions in.
+   */
+  if(lazy->num_flushes == flushes)
+    from->next[class] = to;
+
+  return to;
+}
+
+int lazy_dfa_match(struct LazyDFA *lazy, const char *input, size_t length)
+{
+  const unsigned char *cur = (const unsigned char *) input;
+  const unsigned char *end = cur + length;
+  struct LazyState *state = lazy_dfa_start(lazy);
+  const int *classes = lazy->classes;
+
+  while(cur < end && !state->dead)
+  {
+    struct LazyState *next = state->next[classes[*cur]];
+
+    if(next == NULL)
+      next = lazy_dfa_step(lazy, state, *cur);
+
+    state = next;
+    cur++;
+  }
+
+  return state->accepting;
+}
+
+/* Find the state for a set of NFA states, or make it. Takes ownership of
+ *  states either way.
+ */
+static struct LazyState *intern_lazy_state(struct LazyDFA *lazy,
+    struct StateArray *states)
+{
+  unsigned long mask = lazy->num_buckets - 1;
+  unsigned long i = hash_state_array(states) & mask;
+  int j;
+
+  while(lazy->buckets[i] != NULL)
+  {
+    if(are_state_arrays_equal(states, lazy->buckets[i]->states))
+    {
+      delete_state_array(states);
+      return lazy->buckets[i];
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  /* It's new. If it won't fit in the budget, start over. */
+  size_t size = lazy_state_size(lazy, states);
+
+  if(lazy->num_states > 0 &&
+      lazy->memory_used + size > lazy->memory_budget)
+  {
+    flush_lazy_dfa(lazy);
+    lazy->num_flushes++;
+  }
+
+  /* Keep the table at most half full */
+  if(2 * (lazy->num_states + 1) > lazy->num_buckets)
+  {
+    struct LazyState **old_buckets = lazy->buckets;
+    int old_num_buckets = lazy->num_buckets;
+
+    lazy->num_buckets *= 2;
+    lazy->buckets = (struct LazyState **)
+      calloc( lazy->num_buckets, sizeof(struct LazyState *) );
+    lazy->memory_used += old_num_buckets * sizeof(struct LazyState *);
+
+    mask = lazy->num_buckets - 1;
+
+    for(j = 0; j < old_num_buckets; j++)
+      if(old_buckets[j] != NULL)
+      {
+        i = hash_state_array(old_buckets[j]->states) & mask;
+        while(lazy->buckets[i] != NULL)
+          i = (i + 1) & mask;
+        lazy->buckets[i] = old_buckets[j];
+      }
+
+    free(old_buckets);
+  }
+
+  mask = lazy->num_buckets - 1;
+  i = hash_state_array(states) & mask;
+  while(lazy->buckets[i] != NULL)
+    i = (i + 1) & mask;
+
+  struct LazyState *state = (struct LazyState *)
+    calloc( 1, sizeof(struct LazyState) +
+        (lazy->csr->num_classes + 1) * sizeof(struct LazyState *) );
+
+  state->states = states;
+  state->dead = (states->num_states == 0);
+
+  for(j = 0; j < states->num_states; j++)
+    if(states->states[j]->accepting)
+      state->accepting = 1;
+
+  if(state->accepting)
+  {
+    state->num_patterns = patterns_of(lazy->closures, states,
+        &state->patterns);
+    size += state->num_patterns * sizeof(int);
+  }
+
+  lazy->buckets[i] = state;
+  lazy->num_states++;
+  lazy->memory_used += size;
+
+  return state;
+}
+
+static size_t lazy_state_size(struct LazyDFA *lazy,
+    struct StateArray *states)
+{
+  return sizeof(struct LazyState) +
+    (lazy->csr->num_classes + 1) * sizeof(struct LazyState *) +
+    sizeof(struct StateArray) +
+    states->num_words * sizeof(unsigned long) +
+    states->num_states * sizeof(struct State *);
+}
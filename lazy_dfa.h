@@ -0,0 +1,86 @@
+/* Headers for lazily built (on-demand) DFAs
+ */
+
+#ifndef __LAZY_DFA_H__
+#define __LAZY_DFA_H__
+
+#include <stddef.h>
+
+/* Memory a lazy DFA may use for its states if nobody says otherwise */
+#define LAZY_DFA_DEFAULT_BUDGET (4 << 20)
+
+/* One state of the DFA: a set of NFA states, and wherever each class of
+ *  bytes has been found to lead from it so far. There's an entry in next
+ *  for each class the DFA has, and one more for bytes in none of them.
+ */
+struct LazyState
+{
+  struct StateArray *states;
+  int accepting;
+  int dead;                      /* The empty set: nothing leads out of it */
+
+  int *patterns;                 /* Which ones it accepts for, if labelled */
+  int num_patterns;
+
+  struct LazyState *next[];      /* NULL until that class is first seen */
+};
+
+/*
+ * A DFA that is only built as far as the input actually takes it. States are
+ *  made with possible_states_from() the first time the input reaches them,
+ *  then remembered. Once the states take up more than the memory budget, all
+ *  of them are thrown away and building starts over from wherever the input
+ *  is at.
+ */
+struct LazyDFA
+{
+  struct FSM *nfa;
+  struct CompiledNFA *csr;
+  struct EpsilonClosures *closures;
+
+  /* The class of the packed NFA's symbol each byte stands for, or
+   *  csr->num_classes for bytes that aren't symbols. Every byte in a class
+   *  goes to the same state, so states only keep where each class goes. A
+   *  byte can only be on one symbol that's on a transition (see
+   *  split_ranges()).
+   */
+  int classes[256];
+
+  /* Every state built so far, hashed by its set of NFA states */
+  struct LazyState **buckets;
+  int num_buckets;
+  int num_states;
+
+  struct LazyState *start;
+
+  /* If set, every step can also start the NFA over, so a state accepts if
+   *  some match ends there rather than one that began at the very start.
+   *  Set it before the first step, or flush after changing it.
+   */
+  int unanchored;
+
+  size_t memory_used;
+  size_t memory_budget;
+  int num_flushes;
+};
+
+struct LazyDFA *new_lazy_dfa(struct FSM *nfa, void **alphabet,
+    int num_symbols, symbol_bytes_func symbol_bytes, size_t memory_budget);
+void delete_lazy_dfa(struct LazyDFA *lazy);
+
+/* Throw away every state built so far */
+void flush_lazy_dfa(struct LazyDFA *lazy);
+
+struct LazyState *lazy_dfa_start(struct LazyDFA *lazy);
+
+/* Where a byte leads from a state, building it if need be.
+ * Building a state can flush the cache, after which from (and every other
+ *  state pointer from before) is no longer valid; only the one returned is.
+ */
+struct LazyState *lazy_dfa_step(struct LazyDFA *lazy, struct LazyState *from,
+    unsigned char byte);
+
+/* Does the NFA accept exactly this input? */
+int lazy_dfa_match(struct LazyDFA *lazy, const char *input, size_t length);
+
+#endif
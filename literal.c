@@ -0,0 +1,385 @@
+/*
+ * literal.c | Required literals, and looking for them quickly
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fsm.h"
+#include "nfa_csr.h"
+#include "literal.h"
+
+/*
+ * The graph the dominators are worked out on has a node for each NFA state,
+ *  then one for each symbol transition (so that transitions can dominate
+ *  things too), then one more that every accepting state leads to.
+ */
+struct LiteralGraph
+{
+  int num_nodes;
+  int *succ_start, *succ;
+  int *pred_start, *pred;
+};
+
+static struct LiteralGraph *build_graph(struct CompiledNFA *csr);
+static void delete_graph(struct LiteralGraph *graph);
+static int *dominators(struct LiteralGraph *graph, int root);
+static int only_follower(struct CompiledNFA *csr, int edge, int *seen,
+    int *list);
+
+int required_literal(struct FSM *nfa, symbol_bytes_func symbol_bytes,
+    char *literal, int max_length)
+{
+  struct CompiledNFA *csr = compile_nfa(nfa, NULL, 0);
+  int n = csr->num_states, m = csr->edge_start[n], accept = n + m;
+  int best_start = 0, best_length = 0, i;
+
+  struct LiteralGraph *graph = build_graph(csr);
+  int *idom = dominators(graph, csr->start);
+
+  /* Walk up from acceptance to the start: the transitions on the way are
+   *  the required ones, last first
+   */
+  int *required = (int *) malloc( (m + 1) * sizeof(int) );
+  int num_required = 0, node = accept;
+
+  if(idom[accept] >= 0)
+    while(node != csr->start)
+    {
+      node = idom[node];
+
+      if(node >= n && node < accept)
+        required[num_required++] = node - n;
+    }
+
+  /* Find the longest run where each transition is only ever followed by the
+   *  next
+   */
+  int *seen = (int *) calloc( n, sizeof(int) );
+  int *list = (int *) malloc( n * sizeof(int) );
+  int run_start = num_required - 1, run_length = 0;
+
+  for(i = num_required - 1; i >= 0; i--)
+  {
+    int low, high;
+
+    /* Only transitions on one byte make a literal; a line break would throw
+     *  out a line-at-a-time search
+     */
+    if(!symbol_bytes(csr->symbols[csr->edges[required[i]].symbol], &low,
+          &high) || low != high || low < 0 || low > 255 || low == '\n')
+    {
+      run_length = 0;
+      continue;
+    }
+
+    if(run_length == 0)
+      run_start = i;
+
+    run_length++;
+
+    if(run_length > best_length)
+    {
+      best_start = run_start;
+      best_length = run_length;
+    }
+
+    if(i == 0 || only_follower(csr, required[i], seen, list) !=
+        required[i - 1])
+      run_length = 0;
+  }
+
+  if(best_length > max_length)
+    best_length = max_length;
+
+  for(i = 0; i < best_length; i++)
+  {
+    int low, high;
+
+    symbol_bytes(csr->symbols[csr->edges[required[best_start - i]].symbol],
+        &low, &high);
+    literal[i] = (char) low;
+  }
+
+  free(seen);
+  free(list);
+  free(required);
+  free(idom);
+  delete_graph(graph);
+  delete_compiled_nfa(csr);
+
+  return best_length;
+}
+
+const char *find_literal(const char *buffer, size_t length,
+    const char *literal, int literal_length)
+{
+  size_t k = literal_length, i = 0;
+
+  if(k == 0 || k > length)
+    return (k == 0) ? buffer : NULL;
+
+  if(k == 1)
+    return (const char *) memchr(buffer, literal[0], length);
+
+#ifdef __SSE2__
+  /* Look for the first and last bytes of the literal 16 places at a time,
+   *  and only compare the rest where both turn up the right distance apart
+   */
+  __m128i first = _mm_set1_epi8(literal[0]);
+  __m128i last = _mm_set1_epi8(literal[k - 1]);
+
+  for(; i + k - 1 + 16 <= length; i += 16)
+  {
+    __m128i at_first = _mm_loadu_si128((const __m128i *) (buffer + i));
+    __m128i at_last = _mm_loadu_si128((const __m128i *) (buffer + i + k - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(first, at_first), _mm_cmpeq_epi8(last, at_last)));
+
+    while(mask)
+    {
+      int bit = __builtin_ctz(mask);
+
+      if(memcmp(buffer + i + bit + 1, literal + 1, k - 2) == 0)
+        return buffer + i + bit;
+
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  /* Whatever's left over (or all of it, without SSE2) */
+  while(i + k <= length)
+  {
+    const char *hit = (const char *)
+      memchr(buffer + i, literal[0], length - k + 1 - i);
+
+    if(hit == NULL)
+      return NULL;
+
+    if(memcmp(hit + 1, literal + 1, k - 1) == 0)
+      return hit;
+
+    i = hit - buffer + 1;
+  }
+
+  return NULL;
+}
+
+static struct LiteralGraph *build_graph(struct CompiledNFA *csr)
+{
+  int n = csr->num_states, m = csr->edge_start[n], accept = n + m;
+  int s, e, i, count;
+  struct LiteralGraph *graph = (struct LiteralGraph *)
+    malloc( sizeof(struct LiteralGraph) );
+
+  graph->num_nodes = n + m + 1;
+  graph->succ_start = (int *) calloc( graph->num_nodes + 1, sizeof(int) );
+  graph->pred_start = (int *) calloc( graph->num_nodes + 1, sizeof(int) );
+
+  /* Successors: a state goes to its epsilon targets, its transitions and
+   *  (if accepting) acceptance; a transition goes to its target
+   */
+  int num_arcs = csr->epsilon_start[n] + 2 * m + n;
+  graph->succ = (int *) malloc( num_arcs * sizeof(int) );
+  graph->pred = (int *) malloc( num_arcs * sizeof(int) );
+
+  count = 0;
+
+  for(s = 0; s < n; s++)
+  {
+    graph->succ_start[s] = count;
+
+    for(i = csr->epsilon_start[s]; i < csr->epsilon_start[s + 1]; i++)
+      graph->succ[count++] = csr->epsilon[i];
+
+    for(e = csr->edge_start[s]; e < csr->edge_start[s + 1]; e++)
+      graph->succ[count++] = n + e;
+
+    if(compiled_accepting(csr, s))
+      graph->succ[count++] = accept;
+  }
+
+  for(e = 0; e < m; e++)
+  {
+    graph->succ_start[n + e] = count;
+    graph->succ[count++] = csr->edges[e].target;
+  }
+
+  graph->succ_start[accept] = graph->succ_start[accept + 1] = count;
+
+  /* Predecessors are the same arcs the other way round */
+  for(i = 0; i < count; i++)
+    graph->pred_start[graph->succ[i] + 1]++;
+
+  for(i = 0; i < graph->num_nodes; i++)
+    graph->pred_start[i + 1] += graph->pred_start[i];
+
+  int *fill = (int *) malloc( graph->num_nodes * sizeof(int) );
+  memcpy(fill, graph->pred_start, graph->num_nodes * sizeof(int));
+
+  for(s = 0; s < graph->num_nodes; s++)
+    for(i = graph->succ_start[s]; i < graph->succ_start[s + 1]; i++)
+      graph->pred[fill[graph->succ[i]]++] = s;
+
+  free(fill);
+
+  return graph;
+}
+
+static void delete_graph(struct LiteralGraph *graph)
+{
+  free(graph->succ_start);
+  free(graph->succ);
+  free(graph->pred_start);
+  free(graph->pred);
+  free(graph);
+}
+
+/* Immediate dominators, by Cooper, Harvey and Kennedy's iterative algorithm.
+ *  -1 for nodes that can't be reached from the root.
+ */
+static int *dominators(struct LiteralGraph *graph, int root)
+{
+  int num_nodes = graph->num_nodes, i, j;
+  int *idom = (int *) malloc( num_nodes * sizeof(int) );
+  int *order = (int *) malloc( num_nodes * sizeof(int) );
+  int *postorder = (int *) malloc( num_nodes * sizeof(int) );
+  int *stack = (int *) malloc( num_nodes * sizeof(int) );
+  int *next_arc = (int *) malloc( num_nodes * sizeof(int) );
+  int num_ordered = 0, top = 0;
+
+  for(i = 0; i < num_nodes; i++)
+  {
+    idom[i] = -1;
+    postorder[i] = -1;
+    next_arc[i] = graph->succ_start[i];
+  }
+
+  /* Number the nodes in postorder, without recursing */
+  stack[top++] = root;
+  postorder[root] = -2;
+
+  while(top)
+  {
+    int v = stack[top - 1];
+
+    if(next_arc[v] < graph->succ_start[v + 1])
+    {
+      int w = graph->succ[next_arc[v]++];
+
+      if(postorder[w] == -1)
+      {
+        postorder[w] = -2;
+        stack[top++] = w;
+      }
+    }
+    else
+    {
+      postorder[v] = num_ordered;
+      order[num_ordered++] = v;
+      top--;
+    }
+  }
+
+  idom[root] = root;
+
+  int changed = 1;
+
+  while(changed)
+  {
+    changed = 0;
+
+    /* Reverse postorder, skipping the root */
+    for(i = num_ordered - 2; i >= 0; i--)
+    {
+      int v = order[i], new_idom = -1;
+
+      for(j = graph->pred_start[v]; j < graph->pred_start[v + 1]; j++)
+      {
+        int p = graph->pred[j];
+
+        if(idom[p] < 0)
+          continue;
+
+        if(new_idom < 0)
+          new_idom = p;
+        else
+        {
+          /* Walk both up the tree until they meet */
+          int a = p, b = new_idom;
+
+          while(a != b)
+          {
+            while(postorder[a] < postorder[b])
+              a = idom[a];
+            while(postorder[b] < postorder[a])
+              b = idom[b];
+          }
+
+          new_idom = a;
+        }
+      }
+
+      if(idom[v] != new_idom)
+      {
+        idom[v] = new_idom;
+        changed = 1;
+      }
+    }
+  }
+
+  free(order);
+  free(postorder);
+  free(stack);
+  free(next_arc);
+
+  return idom;
+}
+
+/* The one transition that can come after a given one, or -1 if there's a
+ *  choice (or the FSM could accept in between)
+ */
+static int only_follower(struct CompiledNFA *csr, int edge, int *seen,
+    int *list)
+{
+  int count = 0, next, follower = -1, found = 1, i;
+
+  /* Go through the epsilon closure of where the transition goes, keeping
+   *  the states it's been to in list
+   */
+  list[count++] = csr->edges[edge].target;
+  seen[csr->edges[edge].target] = 1;
+
+  for(next = 0; next < count && found; next++)
+  {
+    int s = list[next];
+
+    if(compiled_accepting(csr, s))
+      found = 0;
+
+    for(i = csr->edge_start[s]; i < csr->edge_start[s + 1] && found; i++)
+    {
+      if(follower >= 0 && follower != i)
+        found = 0;
+      follower = i;
+    }
+
+    for(i = csr->epsilon_start[s]; i < csr->epsilon_start[s + 1]; i++)
+      if(!seen[csr->epsilon[i]])
+      {
+        seen[csr->epsilon[i]] = 1;
+        list[count++] = csr->epsilon[i];
+      }
+  }
+
+  /* Leave seen clear for next time */
+  for(i = 0; i < count; i++)
+    seen[list[i]] = 0;
+
+  return found ? follower : -1;
+}
@@ -0,0 +1,25 @@
+/* Headers for finding literal strings that every match must contain
+ */
+
+#ifndef __LITERAL_H__
+#define __LITERAL_H__
+
+#include <stddef.h>
+
+/* Find the longest run of bytes that every string an NFA accepts has in it,
+ *  such as "xyz" for ab(c|d)*xyz, and put up to max_length of it in literal.
+ * Returns its length, or 0 if there isn't one.
+ *
+ * A transition is required if the FSM can't get from the start to an
+ *  accepting state without it: if it dominates acceptance. Required
+ *  transitions make a literal where each one is the only thing the one
+ *  before can be followed by.
+ */
+int required_literal(struct FSM *nfa, symbol_bytes_func symbol_bytes,
+    char *literal, int max_length);
+
+/* The first place a literal turns up in a buffer, or NULL */
+const char *find_literal(const char *buffer, size_t length,
+    const char *literal, int literal_length);
+
+#endif
@@ -4,6 +4,9 @@
 #include "fsm.h"
 #include "dot_output.h"
 #include "dfsm.h"
+#include "stats.h"
+#include "simplify.h"
+#include "ranges.h"
 
 /*
  * regexp     -> option
@@ -13,13 +16,25 @@
  *             | '(' option ')' '*'
  *             | CHARACTER '*'
  *             | CHARACTER
+ *
+ * where a CHARACTER is anything parse_atom() takes: a character, an escape,
+ *  "." or a class in brackets.
  */
 
+/* Longest a class in brackets can be */
+#define MAX_ATOM_LENGTH 1024
+
 char token;
 
 void **alphabet;
 int alphabet_size = 0;
 
+/* Every symbol's name, by number */
+struct SymbolTable *symbol_table = NULL;
+
+/* Everything for the regexp being read comes out of here */
+struct Arena *arena;
+
 void match(char c);
 void getToken();
 void error();
@@ -28,8 +43,11 @@ struct FSM *regexp();
 struct FSM *option();
 struct FSM *sequence();
 struct FSM *subexp();
+struct FSM *character();
+int escaped_char();
+int starts_character(int c);
 
-int cmp(void *left, void *right);
+void *alphabet_range(int low, int high);
 char *symbol_string(void *value);
 char *id_string(void *id);
 char *meta_id_string(void *id);
@@ -67,13 +85,9 @@ struct FSM *option()
   while(token == '|')
   {
     match('|');
-    struct FSM *temp = left;
     struct FSM *right = sequence();
 
     left = fsmunion(left, right);
-
-    free(temp);
-    free(right);
   }
 
   return left;
@@ -82,15 +96,11 @@ struct FSM *option()
 struct FSM *sequence()
 {
   struct FSM *left = subexp();
-  while(token >= 'a' && token <= 'z')
+  while(starts_character(token))
   {
-    struct FSM *temp = left;
     struct FSM *right = subexp();
 
     left = fsmcat(left, right);
-
-    free(temp);
-    free(right);
   }
 
   return left;
@@ -106,44 +116,157 @@ struct FSM *subexp()
     match(')');
   }
   else
+    fsm = character();
+  
+  if(token == '*')
   {
-    fsm = (struct FSM *) malloc(sizeof(struct FSM));
-    fsm->num_states = 0;
-    add_state(fsm, new_state(NULL, cmp));
-    add_state(fsm, new_state(NULL, cmp));
-    fsm->start_state = fsm->states[0];
-    fsm->states[1]->accepting = 1;
+    match('*');
+    fsm = fsmclosure(fsm);
+  }
 
-    char s[2];
-    sprintf(s, "%c", token);
+  return fsm;
+}
+
+/* A CHARACTER, starting with token: the rest of it (an escape, or a class
+ *  up to its "]") gets read in before it's parsed
+ */
+struct FSM *character()
+{
+  struct ByteRange ranges[MAX_BYTE_RANGES];
+  char text[MAX_ATOM_LENGTH + 1];
+  int length = 0, parsed, num_ranges, i, c;
 
-    add_if_not_present(&alphabet, &alphabet_size, strdup(s));
-    add_transition(fsm->states[0], fsm->states[1], strdup(s));
+  text[length++] = token;
 
-    match(token);
+  if(token == '\\')
+  {
+    text[length++] = c = escaped_char();
+
+    if(c == 'x')
+    {
+      text[length++] = escaped_char();
+      text[length++] = escaped_char();
+    }
   }
-  
-  if(token == '*')
+  else if(token == '[')
   {
-    match('*');
-    struct FSM *temp = fsm;
-    fsm = fsmclosure(fsm);
-    free(temp); 
+    c = getchar();
+
+    /* Neither a "^" nor then a "]" straight away closes it */
+    if(c == '^')
+    {
+      text[length++] = c;
+      c = getchar();
+    }
+
+    if(c == ']')
+    {
+      text[length++] = c;
+      c = getchar();
+    }
+
+    while(c != ']')
+    {
+      if(c == EOF || c == '\n' || length >= MAX_ATOM_LENGTH - 2)
+        error();
+
+      text[length++] = c;
+
+      /* Whatever's escaped can't close it either */
+      if(c == '\\')
+        text[length++] = escaped_char();
+
+      c = getchar();
+    }
+
+    text[length++] = c;
   }
 
+  text[length] = '\0';
+
+  num_ranges = parse_atom(text, &parsed, ranges);
+
+  if(num_ranges < 0 || parsed != length)
+    error();
+
+  struct FSM *fsm = new_fsm(arena);
+  add_state(fsm, new_state(arena, NULL));
+  add_state(fsm, new_state(arena, NULL));
+  fsm->start_state = fsm->states[0];
+  fsm->states[1]->accepting = 1;
+
+  for(i = 0; i < num_ranges; i++)
+    add_transition(fsm->states[0], fsm->states[1],
+        alphabet_range(ranges[i].low, ranges[i].high));
+
+  getToken();
+
   return fsm;
 }
 
+/* The next character of an escape, which can't be the end of the line, or
+ *  the next regexp would be read in as the rest of this one
+ */
+int escaped_char()
+{
+  int c = getchar();
+
+  if(c == EOF || c == '\n')
+    error();
+
+  return c;
+}
+
+/* Could a CHARACTER start with c? */
+int starts_character(int c)
+{
+  return c != EOF && c != '\0' && strchr("|*()] \t\n", c) == NULL;
+}
+
 int main(int argc, char **argv)
 {
-  int input_number = 0;
+  int input_number = 0, i;
   struct FSM *fsm;
 
+  /* With --stats, a line of JSON on stderr for each regexp about what went
+   *  into it. With --simplify, the NFAs drawn are simplified ones, and how
+   *  much smaller they got goes on stderr.
+   */
+  int show_stats = 0, simplify = 0;
+
+  for(i = 1; i < argc; i++)
+    if(strcmp(argv[i], "--stats") == 0)
+      show_stats = 1;
+    else if(strcmp(argv[i], "--simplify") == 0)
+      simplify = 1;
+    else
+    {
+      fprintf(stderr, "usage: %s [--stats] [--simplify]\n", argv[0]);
+      return 1;
+    }
+
+  if(show_stats && !stats_enabled())
+  {
+    fprintf(stderr, "%s: built with NO_STATS, so there are none\n", argv[0]);
+    show_stats = 0;
+  }
+
+  /* Made up front, not by the first character read, so that nothing that
+   *  looks symbols up has to wonder whether there's a table yet
+   */
+  symbol_table = new_symbol_table();
+
   getToken();
   while(!feof(stdin))
   {
+    arena = new_arena();
+
+    reset_stats(&thread_stats);
+    STATS_START(STATS_PARSE);
     fsm = regexp();
-    int i, digits, temp;
+    STATS_STOP(STATS_PARSE);
+
+    int digits, temp;
     char *s;
 
     input_number++;
@@ -157,11 +280,22 @@ int main(int argc, char **argv)
 
     free(s);
 
+    if(simplify)
+    {
+      struct SimplifyReport report;
+
+      simplify_fsm(fsm, &report);
+      fprintf(stderr, "%i.dot: %i states and %i transitions, %i and %i "
+          "simplified\n", input_number, report.states_before,
+          report.transitions_before, report.states_after,
+          report.transitions_after);
+    }
+
     for(i = 0; i < fsm->num_states; i++)
     {
       temp = i;
       for(digits = 1; temp /= 10; digits++);
-      s = (char *) malloc((digits + 2) * sizeof(char));
+      s = (char *) arena_alloc(arena, (digits + 2) * sizeof(char));
       sprintf(s, "s%i", i);
       fsm->states[i]->id = s;
     }
@@ -169,29 +303,30 @@ int main(int argc, char **argv)
     fprint_fsm(file, fsm, symbol_string, id_string);
 
     fclose(file);
+
+    if(show_stats)
+    {
+      char name[16];
+      sprintf(name, "%i.dot", input_number);
+      fprint_stats(stderr, name, &thread_stats, arena);
+    }
+
+    /* And that's the whole automaton gone in one go */
+    delete_arena(arena);
   }
 
   return 0;
 }
 
-int cmp(void *left, void *right)
+/* The symbol for a range of bytes, shared by every transition on it */
+void *alphabet_range(int low, int high)
 {
-  if(left == EPSILON && right != EPSILON)
-    return -1;
-  else if(right == EPSILON && left != EPSILON)
-    return 1;
-  else if(left == right)
-    return 0;
-  else
-    return strcmp((char *) left, (char *) right);
+  return intern_range(symbol_table, low, high, &alphabet, &alphabet_size);
 }
 
 char *symbol_string(void *value)
 {
-  if(value == EPSILON)
-    return strdup("&#949;");
-  else
-    return strdup((char *) value);
+  return range_label(symbol_table, value);
 }
 
 char *meta_id_string(void *id)
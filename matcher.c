@@ -0,0 +1,55 @@
+/*
+ * matcher.c | Picking a matching engine for a pattern
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "bit_parallel.h"
+#include "lazy_dfa.h"
+#include "matcher.h"
+
+struct Matcher *new_matcher(struct FSM *nfa, void **alphabet, int num_symbols,
+    symbol_bytes_func symbol_bytes, size_t memory_budget)
+{
+  struct Matcher *matcher = (struct Matcher *)
+    malloc( sizeof(struct Matcher) );
+
+  matcher->bit_parallel = NULL;
+  matcher->lazy = NULL;
+
+  if(count_positions(nfa) <= BIT_PARALLEL_MAX_POSITIONS)
+    matcher->bit_parallel = new_bit_parallel(nfa, symbol_bytes);
+
+  if(matcher->bit_parallel != NULL)
+    matcher->engine = MATCHER_BIT_PARALLEL;
+  else
+  {
+    matcher->engine = MATCHER_LAZY_DFA;
+    matcher->lazy = new_lazy_dfa(nfa, alphabet, num_symbols, symbol_bytes,
+        memory_budget);
+  }
+
+  return matcher;
+}
+
+void delete_matcher(struct Matcher *matcher)
+{
+  if(matcher->bit_parallel != NULL)
+    delete_bit_parallel(matcher->bit_parallel);
+
+  if(matcher->lazy != NULL)
+    delete_lazy_dfa(matcher->lazy);
+
+  free(matcher);
+}
+
+int matcher_match(struct Matcher *matcher, const char *input, size_t length)
+{
+  if(matcher->engine == MATCHER_BIT_PARALLEL)
+    return bit_parallel_match(matcher->bit_parallel, input, length);
+  else
+    return lazy_dfa_match(matcher->lazy, input, length);
+}
@@ -0,0 +1,33 @@
+/* Headers for matching with whichever engine suits the pattern
+ */
+
+#ifndef __MATCHER_H__
+#define __MATCHER_H__
+
+#include <stddef.h>
+
+#define MATCHER_BIT_PARALLEL 1
+#define MATCHER_LAZY_DFA 2
+
+/*
+ * Small patterns (up to BIT_PARALLEL_MAX_POSITIONS symbol occurrences) are
+ *  run bit-parallel, which needs no subset construction at all and a few
+ *  kilobytes of tables. Anything bigger gets a lazily built DFA, whose
+ *  states may take up memory_budget bytes (see new_lazy_dfa()).
+ */
+struct Matcher
+{
+  int engine;
+
+  struct BitParallel *bit_parallel;
+  struct LazyDFA *lazy;
+};
+
+struct Matcher *new_matcher(struct FSM *nfa, void **alphabet, int num_symbols,
+    symbol_bytes_func symbol_bytes, size_t memory_budget);
+void delete_matcher(struct Matcher *matcher);
+
+/* Does the pattern match exactly this input? */
+int matcher_match(struct Matcher *matcher, const char *input, size_t length);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ * minimize.c | Hopcroft's DFA minimization
+ *
+ * We start with a block of the states that don't accept, and one for the
+ *  accepting states of each set of patterns (or just one for all of them, if
+ *  there aren't any patterns), and keep splitting blocks until every state
+ *  in a block goes to the same block on every symbol.
+ * A block B and a symbol a make a "splitter": any block with some states
+ *  that go into B on a and some that don't gets split in two. Only the
+ *  smaller half of a split ever needs to be used as a splitter again, which
+ *  is what makes this O(n log n).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "minimize.h"
+#include "stats.h"
+
+extern void *EPSILON;
+
+static int collect_symbols(struct Transition *root, void ***symbols,
+    int *num_symbols);
+static int compare_acceptance(const void *left, const void *right);
+
+struct FSM *minimize_fsm(struct FSM *dfa)
+{
+  int n = dfa->num_states, i, j, a;
+  int num_symbols = 0;
+  void **symbols = NULL;
+
+  STATS_START(STATS_MINIMIZE);
+
+  /* First find out what symbols there are, in sorted order */
+  for(i = 0; i < n; i++)
+    if(dfa->states[i]->transitions_tree != NULL &&
+        !collect_symbols(dfa->states[i]->transitions_tree, &symbols,
+          &num_symbols))
+    {
+      free(symbols);
+      STATS_STOP(STATS_MINIMIZE);
+      return NULL;
+    }
+
+  /* Then lay the transitions out as delta[state * num_symbols + symbol].
+   * State n is an extra dead state standing in for missing transitions.
+   */
+  int sink = n, total = n + 1, needs_sink = 0;
+  int *delta = (int *) malloc( (size_t) total * (num_symbols + 1) *
+      sizeof(int) );
+
+  for(i = 0; i < total; i++)
+    for(a = 0; a < num_symbols; a++)
+    {
+      struct Transition *t = (i == sink) ? NULL :
+        transition_from_with_input(dfa->states[i], symbols[a]);
+
+      if(t == NULL)
+      {
+        delta[i * num_symbols + a] = sink;
+        needs_sink = 1;
+      }
+      else
+        delta[i * num_symbols + a] = t->to[0]->index;
+    }
+
+  if(!needs_sink)
+    total = n;
+
+  /* Reverse the transitions: for each symbol and state, the states that go
+   *  to it on that symbol, all packed into one array.
+   */
+  int *reverse_start = (int *) calloc( (size_t) num_symbols * total + 1,
+      sizeof(int) );
+  int *reverse = (int *) malloc( ((size_t) num_symbols * total + 1) *
+      sizeof(int) );
+
+  for(i = 0; i < total; i++)
+    for(a = 0; a < num_symbols; a++)
+      reverse_start[a * total + delta[i * num_symbols + a] + 1]++;
+
+  for(i = 0; i < num_symbols * total; i++)
+    reverse_start[i + 1] += reverse_start[i];
+
+  int *fill = (int *) malloc( ((size_t) num_symbols * total + 1) *
+      sizeof(int) );
+  memcpy(fill, reverse_start, ((size_t) num_symbols * total + 1) * sizeof(int));
+
+  for(i = 0; i < total; i++)
+    for(a = 0; a < num_symbols; a++)
+      reverse[fill[a * total + delta[i * num_symbols + a]]++] = i;
+
+  free(fill);
+
+  /* The partition: elements holds the states grouped by block, block b
+   *  being elements[first[b]] up to elements[end[b]]. While splitting, the
+   *  states of a block that have been marked are moved to its front, up
+   *  to mid[b].
+   */
+  int *elements = (int *) malloc( total * sizeof(int) );
+  int *location = (int *) malloc( total * sizeof(int) );
+  int *block = (int *) malloc( total * sizeof(int) );
+  int *first = (int *) malloc( total * sizeof(int) );
+  int *mid = (int *) malloc( total * sizeof(int) );
+  int *end = (int *) malloc( total * sizeof(int) );
+  int num_blocks = 0, count = 0;
+
+  /* Sort the states so that ones that accept the same way are together
+   *  (the sink being NULL), and make each run of them a block
+   */
+  struct State **sorted = (struct State **)
+    malloc( total * sizeof(struct State *) );
+
+  for(i = 0; i < total; i++)
+    sorted[i] = (i == sink) ? NULL : dfa->states[i];
+
+  qsort(sorted, total, sizeof(struct State *), compare_acceptance);
+
+  for(i = 0; i < total; i++)
+  {
+    int state = (sorted[i] == NULL) ? sink : sorted[i]->index;
+
+    if(i == 0 || compare_acceptance(&sorted[i - 1], &sorted[i]) != 0)
+    {
+      if(num_blocks > 0)
+        end[num_blocks - 1] = count;
+
+      first[num_blocks] = mid[num_blocks] = count;
+      num_blocks++;
+    }
+
+    location[state] = count;
+    elements[count++] = state;
+    block[state] = num_blocks - 1;
+  }
+
+  end[num_blocks - 1] = count;
+
+  free(sorted);
+
+  /* Splitters waiting to be used, and which ones are waiting */
+  char *waiting = (char *) calloc( (size_t) total * (num_symbols + 1), 1 );
+  int *pending_block = (int *) malloc( (size_t) total * (num_symbols + 1) *
+      sizeof(int) );
+  int *pending_symbol = (int *) malloc( (size_t) total * (num_symbols + 1) *
+      sizeof(int) );
+  int num_pending = 0;
+
+  int *splitter = (int *) malloc( total * sizeof(int) );
+  int *touched = (int *) malloc( total * sizeof(int) );
+
+  /* Every block but the biggest has to be a splitter to start with */
+  int biggest = 0;
+
+  for(j = 1; j < num_blocks; j++)
+    if(end[j] - first[j] > end[biggest] - first[biggest])
+      biggest = j;
+
+  for(j = 0; j < num_blocks; j++)
+    if(j != biggest)
+      for(a = 0; a < num_symbols; a++)
+      {
+        waiting[j * num_symbols + a] = 1;
+        pending_block[num_pending] = j;
+        pending_symbol[num_pending++] = a;
+      }
+
+  while(num_pending)
+  {
+    int b = pending_block[--num_pending];
+    int symbol = pending_symbol[num_pending];
+    int size = end[b] - first[b], num_touched = 0;
+
+    waiting[b * num_symbols + symbol] = 0;
+
+    /* Marking moves states around inside their blocks, b included, so take
+     *  a copy of b to go through.
+     */
+    memcpy(splitter, elements + first[b], size * sizeof(int));
+
+    for(i = 0; i < size; i++)
+    {
+      int to = splitter[i];
+
+      for(j = reverse_start[symbol * total + to];
+          j < reverse_start[symbol * total + to + 1]; j++)
+      {
+        int from = reverse[j], from_block = block[from];
+
+        if(location[from] < mid[from_block])
+          continue;
+
+        /* Mark it by swapping it to the end of the marked part */
+        int other = elements[mid[from_block]];
+
+        elements[location[from]] = other;
+        location[other] = location[from];
+        elements[mid[from_block]] = from;
+        location[from] = mid[from_block];
+
+        if(mid[from_block]++ == first[from_block])
+          touched[num_touched++] = from_block;
+      }
+    }
+
+    for(i = 0; i < num_touched; i++)
+    {
+      int x = touched[i];
+
+      if(mid[x] == end[x])
+      {
+        /* Every state in it was marked, so there's nothing to split */
+        mid[x] = first[x];
+        continue;
+      }
+
+      /* The marked states become a new block */
+      int y = num_blocks++;
+
+      first[y] = mid[y] = first[x];
+      end[y] = mid[x];
+      first[x] = mid[x] = end[y];
+
+      for(j = first[y]; j < end[y]; j++)
+        block[elements[j]] = y;
+
+      for(a = 0; a < num_symbols; a++)
+      {
+        int add;
+
+        if(waiting[x * num_symbols + a])
+          add = y;
+        else
+          add = (end[y] - first[y] <= end[x] - first[x]) ? y : x;
+
+        waiting[add * num_symbols + a] = 1;
+        pending_block[num_pending] = add;
+        pending_symbol[num_pending++] = a;
+      }
+    }
+  }
+
+  /* Now make a state for each block, breadth first from the start state */
+  struct FSM *min = new_fsm(dfa->arena);
+  struct State **made = (struct State **)
+    calloc( num_blocks, sizeof(struct State *) );
+  int *representative = (int *) malloc( num_blocks * sizeof(int) );
+
+  /* The block each new state was made for, in the order they were made */
+  int *made_for = (int *) malloc( num_blocks * sizeof(int) );
+
+  /* Each block is represented by the first of its states */
+  for(i = n - 1; i >= 0; i--)
+    representative[block[i]] = i;
+
+  int b = block[dfa->start_state->index], next;
+
+  made[b] = new_state(min->arena, dfa->start_state->id);
+  made[b]->accepting = dfa->start_state->accepting;
+  set_patterns(made[b], dfa->start_state->patterns,
+      dfa->start_state->num_patterns);
+  made_for[0] = b;
+  add_state(min, made[b]);
+  min->start_state = made[b];
+
+  for(next = 0; next < min->num_states; next++)
+  {
+    int from = representative[made_for[next]];
+
+    for(a = 0; a < num_symbols; a++)
+    {
+      int to = delta[from * num_symbols + a];
+
+      /* Missing transitions stay missing */
+      if(to == sink)
+        continue;
+
+      b = block[to];
+
+      if(made[b] == NULL)
+      {
+        int r = representative[b];
+
+        made[b] = new_state(min->arena, dfa->states[r]->id);
+        made[b]->accepting = dfa->states[r]->accepting;
+        set_patterns(made[b], dfa->states[r]->patterns,
+            dfa->states[r]->num_patterns);
+        made_for[min->num_states] = b;
+        add_state(min, made[b]);
+      }
+
+      add_transition(min->states[next], made[b], symbols[a]);
+    }
+  }
+
+  free(symbols);
+  free(delta);
+  free(reverse_start);
+  free(reverse);
+  free(elements);
+  free(location);
+  free(block);
+  free(first);
+  free(mid);
+  free(end);
+  free(waiting);
+  free(pending_block);
+  free(pending_symbol);
+  free(splitter);
+  free(touched);
+  free(made);
+  free(representative);
+  free(made_for);
+
+  STATS_STOP(STATS_MINIMIZE);
+
+  return min;
+}
+
+/* Add every symbol in a transition tree to a sorted array of symbols, if it
+ *  isn't there already. Returns 0 if this turns out not to be a DFA.
+ */
+static int collect_symbols(struct Transition *root, void ***symbols,
+    int *num_symbols)
+{
+  if(root->left != NULL &&
+      !collect_symbols(root->left, symbols, num_symbols))
+    return 0;
+
+  if(root->value == EPSILON || root->num_to != 1)
+    return 0;
+
+  /* Binary search for where it goes */
+  int low = 0, high = *num_symbols, i;
+
+  while(low < high)
+  {
+    int middle = (low + high) / 2;
+    int comparison = compare_symbols(root->value, (*symbols)[middle]);
+
+    if(comparison == 0)
+    {
+      low = -1;
+      break;
+    }
+    else if(comparison < 0)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+
+  if(low >= 0)
+  {
+    *symbols = (void **) realloc(*symbols,
+        (*num_symbols + 1) * sizeof(void *));
+
+    for(i = *num_symbols; i > low; i--)
+      (*symbols)[i] = (*symbols)[i - 1];
+
+    (*symbols)[low] = root->value;
+    (*num_symbols)++;
+  }
+
+  if(root->right != NULL &&
+      !collect_symbols(root->right, symbols, num_symbols))
+    return 0;
+
+  return 1;
+}
+
+/* Orders states (and NULL, for the sink) by how they accept: not at all
+ *  first, then by their lists of patterns
+ */
+static int compare_acceptance(const void *left, const void *right)
+{
+  struct State *l = *(struct State **) left, *r = *(struct State **) right;
+  int l_accepting = (l != NULL && l->accepting);
+  int r_accepting = (r != NULL && r->accepting);
+  int i;
+
+  if(l_accepting != r_accepting || !l_accepting)
+    return l_accepting - r_accepting;
+
+  if(l->num_patterns != r->num_patterns)
+    return (l->num_patterns > r->num_patterns) ? 1 : -1;
+
+  for(i = 0; i < l->num_patterns; i++)
+    if(l->patterns[i] != r->patterns[i])
+      return (l->patterns[i] > r->patterns[i]) ? 1 : -1;
+
+  return 0;
+}
@@ -0,0 +1,18 @@
+/* Headers for DFA minimization
+ */
+
+#ifndef __MINIMIZE_H__
+#define __MINIMIZE_H__
+
+/* Make the smallest DFA that accepts the same language as dfa, by Hopcroft's
+ *  partition refinement. dfa must be deterministic, and its states must have
+ *  their index set, as add_state() does. It doesn't have to be complete:
+ *  missing transitions are taken to go to a dead state.
+ * Each new state is labelled with the id of one of the states it replaces.
+ *  States are numbered breadth first from the start state, and any that
+ *  can't be reached are left out.
+ * The result is allocated from the DFA's arena.
+ */
+struct FSM *minimize_fsm(struct FSM *dfa);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * nfa_csr.c | Packing an FSM into compressed sparse rows
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "nfa_csr.h"
+
+extern void *EPSILON;
+
+static void count_edges(struct Transition *root, int *num_edges,
+    int *num_epsilon, void ***symbols, int *num_symbols);
+static void fill_edges(struct CompiledNFA *csr, struct Transition *root,
+    int *edge, int *epsilon);
+static void compute_symbol_classes(struct CompiledNFA *csr);
+static int compare_pairs(const void *left, const void *right);
+
+struct CompiledNFA *compile_nfa(struct FSM *nfa, void **alphabet,
+    int num_symbols)
+{
+  void **symbols = NULL;
+  int n = nfa->num_states, num_distinct = 0, num_edges = 0, num_epsilon = 0;
+  int num_words = (n + 8 * sizeof(unsigned long) - 1) /
+    (8 * sizeof(unsigned long));
+  int i;
+
+  /* Every distinct symbol, whether it's in the alphabet or on an edge */
+  for(i = 0; i < num_symbols; i++)
+    add_symbol_sorted(&symbols, &num_distinct, alphabet[i]);
+
+  for(i = 0; i < n; i++)
+    if(nfa->states[i]->transitions_tree != NULL)
+      count_edges(nfa->states[i]->transitions_tree, &num_edges, &num_epsilon,
+          &symbols, &num_distinct);
+
+  /* Now we know how big everything is, carve it all out of one block, the
+   *  most strictly aligned arrays first.
+   */
+  size_t size = sizeof(struct CompiledNFA) +
+    num_distinct * sizeof(void *) +
+    num_words * sizeof(unsigned long) +
+    2 * (n + 1) * sizeof(int) +
+    3 * num_distinct * sizeof(int) +
+    num_edges * sizeof(struct CompiledEdge) +
+    num_epsilon * sizeof(int);
+
+  char *block = (char *) calloc( 1, size );
+  struct CompiledNFA *csr = (struct CompiledNFA *) block;
+
+  block += sizeof(struct CompiledNFA);
+  csr->symbols = (void **) block;
+  block += num_distinct * sizeof(void *);
+  csr->accepting = (unsigned long *) block;
+  block += num_words * sizeof(unsigned long);
+  csr->edge_start = (int *) block;
+  block += (n + 1) * sizeof(int);
+  csr->epsilon_start = (int *) block;
+  block += (n + 1) * sizeof(int);
+  csr->symbol_class = (int *) block;
+  block += num_distinct * sizeof(int);
+  csr->class_symbol = (int *) block;
+  block += num_distinct * sizeof(int);
+  csr->next_in_class = (int *) block;
+  block += num_distinct * sizeof(int);
+  csr->edges = (struct CompiledEdge *) block;
+  block += num_edges * sizeof(struct CompiledEdge);
+  csr->epsilon = (int *) block;
+
+  csr->nfa = nfa;
+  csr->num_states = n;
+  csr->start = nfa->start_state->index;
+  csr->num_symbols = num_distinct;
+
+  if(num_distinct)
+    memcpy(csr->symbols, symbols, num_distinct * sizeof(void *));
+  free(symbols);
+
+  /* Walking each transition tree in order hands us the symbols in sorted
+   *  order, so each state's edges come out sorted by symbol for free.
+   */
+  int edge = 0, epsilon = 0;
+
+  for(i = 0; i < n; i++)
+  {
+    csr->edge_start[i] = edge;
+    csr->epsilon_start[i] = epsilon;
+
+    if(nfa->states[i]->transitions_tree != NULL)
+      fill_edges(csr, nfa->states[i]->transitions_tree, &edge, &epsilon);
+
+    if(nfa->states[i]->accepting)
+      csr->accepting[i / (8 * sizeof(unsigned long))] |=
+        1UL << (i % (8 * sizeof(unsigned long)));
+  }
+
+  csr->edge_start[n] = edge;
+  csr->epsilon_start[n] = epsilon;
+
+  compute_symbol_classes(csr);
+
+  return csr;
+}
+
+void delete_compiled_nfa(struct CompiledNFA *csr)
+{
+  /* It's all one block */
+  free(csr);
+}
+
+int compiled_symbol(struct CompiledNFA *csr, void *symbol)
+{
+  int low = 0, high = csr->num_symbols;
+
+  while(low < high)
+  {
+    int middle = (low + high) / 2;
+    int comparison = compare_symbols(symbol, csr->symbols[middle]);
+
+    if(comparison == 0)
+      return middle;
+    else if(comparison < 0)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+
+  return -1;
+}
+
+int add_symbol_sorted(void ***symbols, int *num_symbols, void *symbol)
+{
+  int low = 0, high = *num_symbols, i;
+
+  /* Binary search for where it goes */
+  while(low < high)
+  {
+    int middle = (low + high) / 2;
+    int comparison = compare_symbols(symbol, (*symbols)[middle]);
+
+    if(comparison == 0)
+      return middle;
+    else if(comparison < 0)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+
+  *symbols = (void **) realloc(*symbols, (*num_symbols + 1) * sizeof(void *));
+
+  for(i = *num_symbols; i > low; i--)
+    (*symbols)[i] = (*symbols)[i - 1];
+
+  (*symbols)[low] = symbol;
+  (*num_symbols)++;
+
+  return low;
+}
+
+static void count_edges(struct Transition *root, int *num_edges,
+    int *num_epsilon, void ***symbols, int *num_symbols)
+{
+  if(root->left != NULL)
+    count_edges(root->left, num_edges, num_epsilon, symbols, num_symbols);
+
+  if(root->value == EPSILON)
+    *num_epsilon += root->num_to;
+  else
+  {
+    *num_edges += root->num_to;
+    add_symbol_sorted(symbols, num_symbols, root->value);
+  }
+
+  if(root->right != NULL)
+    count_edges(root->right, num_edges, num_epsilon, symbols, num_symbols);
+}
+
+static void fill_edges(struct CompiledNFA *csr, struct Transition *root,
+    int *edge, int *epsilon)
+{
+  int i;
+
+  if(root->left != NULL)
+    fill_edges(csr, root->left, edge, epsilon);
+
+  if(root->value == EPSILON)
+    for(i = 0; i < root->num_to; i++)
+      csr->epsilon[(*epsilon)++] = root->to[i]->index;
+  else
+  {
+    int symbol = compiled_symbol(csr, root->value);
+
+    for(i = 0; i < root->num_to; i++)
+    {
+      csr->edges[*edge].symbol = symbol;
+      csr->edges[(*edge)++].target = root->to[i]->index;
+    }
+  }
+
+  if(root->right != NULL)
+    fill_edges(csr, root->right, edge, epsilon);
+}
+
+/* Two symbols are in the same class if they're on exactly the same
+ *  (from, to) pairs of states
+ */
+static void compute_symbol_classes(struct CompiledNFA *csr)
+{
+  int n = csr->num_states, num_edges = csr->edge_start[n];
+  int s, e, i, j;
+
+  /* Sort each symbol's pairs out into a run of their own */
+  int *pair_start = (int *) calloc( csr->num_symbols + 1, sizeof(int) );
+  int *pairs = (int *) malloc( 2 * num_edges * sizeof(int) );
+  unsigned long *hashes = (unsigned long *)
+    malloc( csr->num_symbols * sizeof(unsigned long) );
+
+  for(e = 0; e < num_edges; e++)
+    pair_start[csr->edges[e].symbol + 1]++;
+
+  for(i = 0; i < csr->num_symbols; i++)
+    pair_start[i + 1] += pair_start[i];
+
+  int *fill = (int *) malloc( csr->num_symbols * sizeof(int) );
+  memcpy(fill, pair_start, csr->num_symbols * sizeof(int));
+
+  for(s = 0; s < n; s++)
+    for(e = csr->edge_start[s]; e < csr->edge_start[s + 1]; e++)
+    {
+      int at = fill[csr->edges[e].symbol]++;
+      pairs[2 * at] = s;
+      pairs[2 * at + 1] = csr->edges[e].target;
+    }
+
+  for(i = 0; i < csr->num_symbols; i++)
+  {
+    int count = pair_start[i + 1] - pair_start[i];
+
+    qsort(pairs + 2 * pair_start[i], count, 2 * sizeof(int), compare_pairs);
+
+    /* FNV-1a, so most symbols in different classes never get compared */
+    hashes[i] = 14695981039346656037UL;
+    for(j = 2 * pair_start[i]; j < 2 * pair_start[i + 1]; j++)
+      hashes[i] = (hashes[i] ^ (unsigned long) pairs[j]) * 1099511628211UL;
+  }
+
+  /* Put each symbol in the first class it belongs in, or a new one. last
+   *  is the latest symbol put in each class, to chain the next one on to.
+   */
+  int *last = (int *) malloc( csr->num_symbols * sizeof(int) );
+  csr->num_classes = 0;
+
+  for(i = 0; i < csr->num_symbols; i++)
+  {
+    int count = pair_start[i + 1] - pair_start[i];
+
+    for(j = 0; j < csr->num_classes; j++)
+    {
+      int first = csr->class_symbol[j];
+
+      if(hashes[first] == hashes[i] &&
+          pair_start[first + 1] - pair_start[first] == count &&
+          memcmp(pairs + 2 * pair_start[first], pairs + 2 * pair_start[i],
+            2 * count * sizeof(int)) == 0)
+        break;
+    }
+
+    if(j == csr->num_classes)
+      csr->class_symbol[csr->num_classes++] = i;
+    else
+      csr->next_in_class[last[j]] = i;
+
+    csr->symbol_class[i] = j;
+    csr->next_in_class[i] = -1;
+    last[j] = i;
+  }
+
+  free(pair_start);
+  free(pairs);
+  free(hashes);
+  free(fill);
+  free(last);
+}
+
+static int compare_pairs(const void *left, const void *right)
+{
+  const int *l = (const int *) left, *r = (const int *) right;
+
+  if(l[0] != r[0])
+    return (l[0] < r[0]) ? -1 : 1;
+
+  return (l[1] > r[1]) - (l[1] < r[1]);
+}
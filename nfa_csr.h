@@ -0,0 +1,73 @@
+/* Headers for NFAs packed into compressed sparse rows
+ */
+
+#ifndef __NFA_CSR_H__
+#define __NFA_CSR_H__
+
+struct CompiledEdge
+{
+  int symbol;    /* Index into the CompiledNFA's symbols */
+  int target;    /* Index of the state it goes to */
+};
+
+/*
+ * An FSM frozen into flat arrays, all in the one allocation, so that the hot
+ *  loops never have to chase State or Transition pointers:
+ *
+ *   edges[edge_start[s]] up to edges[edge_start[s + 1]] are the symbol
+ *    transitions out of state s, sorted by symbol;
+ *   epsilon[epsilon_start[s]] up to epsilon[epsilon_start[s + 1]] are the
+ *    states s has epsilon transitions to;
+ *   accepting is a bitset over states, laid out like a StateArray's.
+ *
+ * Symbols become small integers: their position in symbols, which holds
+ *  every distinct symbol of the alphabet, sorted.
+ * Symbols that every state treats the same, going to the same places (or
+ *  nowhere), are in the same class. Anything worked out for one symbol
+ *  holds for the rest of its class, so it only needs working out once.
+ * States keep the indices they have in nfa, which is there to get back to
+ *  the State objects.
+ */
+struct CompiledNFA
+{
+  struct FSM *nfa;
+  int num_states;
+  int start;
+
+  void **symbols;
+  int num_symbols;
+
+  int *symbol_class;    /* The class of each symbol */
+  int *class_symbol;    /* The first symbol in each class */
+  int *next_in_class;   /* The symbol after each one in its class, or -1 */
+  int num_classes;
+
+  int *edge_start;
+  struct CompiledEdge *edges;
+  int *epsilon_start;
+  int *epsilon;
+  unsigned long *accepting;
+};
+
+/* Pack an NFA. The NFA's states must have their index set, as add_state()
+ *  does.
+ */
+struct CompiledNFA *compile_nfa(struct FSM *nfa, void **alphabet,
+    int num_symbols);
+void delete_compiled_nfa(struct CompiledNFA *csr);
+
+/* Which symbol number a symbol is, or -1 if it isn't one of them */
+int compiled_symbol(struct CompiledNFA *csr, void *symbol);
+
+static inline int compiled_accepting(struct CompiledNFA *csr, int state)
+{
+  return (csr->accepting[state / (8 * sizeof(unsigned long))] >>
+      (state % (8 * sizeof(unsigned long)))) & 1;
+}
+
+/* Put a symbol into a sorted array of distinct symbols, unless it's already
+ *  there. Returns its position either way.
+ */
+int add_symbol_sorted(void ***symbols, int *num_symbols, void *symbol);
+
+#endif
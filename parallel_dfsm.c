@@ -0,0 +1,392 @@
+/*
+ * parallel_dfsm.c | Multi-threaded subset construction
+ *
+ * Every worker thread has its own queue of metastates whose transitions
+ *  haven't been worked out yet. A worker takes work from the bottom of its
+ *  own queue, and when that runs dry, steals from the top of someone else's.
+ * Metastates are interned in a table split into shards, each with its own
+ *  lock, so threads only contend when they hit the same shard.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "nfa_csr.h"
+#include "parallel_dfsm.h"
+#include "stats.h"
+
+/* Must be a power of two */
+#define NUM_SHARDS 64
+
+struct WorkQueue
+{
+  struct State **items;
+  int top, bottom, capacity;
+  pthread_mutex_t lock;
+};
+
+struct Determinizer
+{
+  struct CompiledNFA *csr;
+  struct EpsilonClosures *closures;
+
+  struct MetastateTable *shards[NUM_SHARDS];
+  pthread_mutex_t shard_locks[NUM_SHARDS];
+
+  struct WorkQueue *queues;
+  int num_threads;
+
+  /* Metastates that have been made but not finished being worked on */
+  atomic_int pending;
+
+  /* Every metastate made is counted against this, under the lock, if it's
+   *  not NULL. Once it's spent, everyone stops.
+   */
+  struct DeterminizeBudget *budget;
+  pthread_mutex_t budget_lock;
+  atomic_int over_budget;
+};
+
+struct Worker
+{
+  struct Determinizer *shared;
+  int id;
+
+  /* Arenas aren't thread safe, so each worker allocates from its own, and
+   *  they all get handed over to the NFA's at the end
+   */
+  struct Arena *arena;
+
+  /* What it counted, to be added to the caller's */
+  struct Stats stats;
+};
+
+static void push_work(struct WorkQueue *queue, struct State *metastate);
+static struct State *pop_work(struct WorkQueue *queue);
+static struct State *steal_work(struct WorkQueue *queue);
+static struct State *intern_metastate(struct Determinizer *d,
+    struct Arena *arena, struct StateArray *states, int *made);
+static void *determinize_worker(void *arg);
+static void renumber_breadth_first(struct FSM *dfa, struct State *start,
+    struct CompiledNFA *csr);
+static void spend_shared_budget(struct Determinizer *d,
+    struct State *metastate);
+
+struct FSM *parallel_deterministic_fsm(struct FSM *ndfa, void **alphabet,
+    int num_symbols, int num_threads, struct DeterminizeBudget *budget)
+{
+  if(num_threads <= 1)
+    return deterministic_fsm_within(ndfa, alphabet, num_symbols, budget);
+
+  struct Determinizer d;
+  int i, made;
+
+  STATS_START(STATS_DETERMINIZE);
+
+  d.csr = compile_nfa(ndfa, alphabet, num_symbols);
+  d.closures = compute_epsilon_closures(d.csr);
+  d.num_threads = num_threads;
+  atomic_init(&d.pending, 0);
+
+  d.budget = budget;
+  pthread_mutex_init(&d.budget_lock, NULL);
+  atomic_init(&d.over_budget, 0);
+
+  if(budget != NULL)
+  {
+    budget->num_states = 0;
+    budget->bytes_used = 0;
+    budget->exceeded = 0;
+  }
+
+  for(i = 0; i < NUM_SHARDS; i++)
+  {
+    d.shards[i] = new_metastate_table();
+    pthread_mutex_init(&d.shard_locks[i], NULL);
+  }
+
+  d.queues = (struct WorkQueue *)
+    malloc( num_threads * sizeof(struct WorkQueue) );
+
+  for(i = 0; i < num_threads; i++)
+  {
+    d.queues[i].capacity = 64;
+    d.queues[i].top = d.queues[i].bottom = 0;
+    d.queues[i].items = (struct State **)
+      malloc( d.queues[i].capacity * sizeof(struct State *) );
+    pthread_mutex_init(&d.queues[i].lock, NULL);
+  }
+
+  /* Seed the first queue with the start metastate */
+  struct State *start = intern_metastate(&d, ndfa->arena,
+      start_states(d.closures), &made);
+  spend_shared_budget(&d, start);
+  atomic_fetch_add(&d.pending, 1);
+  push_work(&d.queues[0], start);
+
+  pthread_t *threads = (pthread_t *) malloc( num_threads * sizeof(pthread_t) );
+  struct Worker *workers = (struct Worker *)
+    malloc( num_threads * sizeof(struct Worker) );
+
+  for(i = 0; i < num_threads; i++)
+  {
+    workers[i].shared = &d;
+    workers[i].id = i;
+    workers[i].arena = (ndfa->arena != NULL) ? new_arena() : NULL;
+    pthread_create(&threads[i], NULL, determinize_worker, &workers[i]);
+  }
+
+  for(i = 0; i < num_threads; i++)
+  {
+    pthread_join(threads[i], NULL);
+    add_stats(&thread_stats, &workers[i].stats);
+
+    if(workers[i].arena != NULL)
+      arena_adopt(ndfa->arena, workers[i].arena);
+  }
+
+  /* Which thread got to which metastate first is down to timing, so put the
+   *  states in an order that isn't.
+   */
+  struct FSM *dfa = NULL;
+
+  if(!atomic_load(&d.over_budget))
+  {
+    dfa = new_fsm(ndfa->arena);
+    dfa->start_state = start;
+    renumber_breadth_first(dfa, start, d.csr);
+  }
+  else if(ndfa->arena == NULL)
+  {
+    /* Nothing else knows about the metastates, so they go here */
+    for(i = 0; i < NUM_SHARDS; i++)
+    {
+      int j;
+
+      for(j = 0; j < d.shards[i]->num_buckets; j++)
+        if(d.shards[i]->buckets[j] != NULL)
+        {
+          delete_state_array(
+              (struct StateArray *) d.shards[i]->buckets[j]->id);
+          delete_state(d.shards[i]->buckets[j]);
+        }
+    }
+  }
+
+  for(i = 0; i < num_threads; i++)
+  {
+    free(d.queues[i].items);
+    pthread_mutex_destroy(&d.queues[i].lock);
+  }
+
+  for(i = 0; i < NUM_SHARDS; i++)
+  {
+    delete_metastate_table(d.shards[i]);
+    pthread_mutex_destroy(&d.shard_locks[i]);
+  }
+
+  free(d.queues);
+  free(threads);
+  free(workers);
+  pthread_mutex_destroy(&d.budget_lock);
+  delete_epsilon_closures(d.closures);
+  delete_compiled_nfa(d.csr);
+
+  STATS_STOP(STATS_DETERMINIZE);
+
+  return dfa;
+}
+
+static void *determinize_worker(void *arg)
+{
+  struct Worker *self = (struct Worker *) arg;
+  struct Determinizer *d = self->shared;
+  struct WorkQueue *mine = &d->queues[self->id];
+  int i, c, made;
+
+  for(;;)
+  {
+    /* Over budget, nobody's getting a DFA, so there's no point going on */
+    if(atomic_load(&d->over_budget))
+      break;
+
+    struct State *metastate = pop_work(mine);
+
+    /* Nothing of our own to do, so go and look for someone else's */
+    for(i = 1; metastate == NULL && i < d->num_threads; i++)
+      metastate = steal_work(&d->queues[(self->id + i) % d->num_threads]);
+
+    if(metastate == NULL)
+    {
+      /* Everything's done only once nobody is still working on something
+       *  that might turn up more.
+       */
+      if(atomic_load(&d->pending) == 0)
+        break;
+
+      sched_yield();
+      continue;
+    }
+
+    /* Its transitions are ours to make, so they come out of our arena */
+    metastate->arena = self->arena;
+
+    for(c = 0; c < d->csr->num_classes; c++)
+    {
+      struct StateArray *possible_states = possible_states_from(d->closures,
+          (struct StateArray *) metastate->id, d->csr->class_symbol[c]);
+
+      struct State *link_to = intern_metastate(d, self->arena,
+          possible_states, &made);
+
+      if(made)
+      {
+        spend_shared_budget(d, link_to);
+
+        /* Count it before this metastate is finished, so pending can't
+         *  touch zero while there's still work about.
+         */
+        atomic_fetch_add(&d->pending, 1);
+        push_work(mine, link_to);
+      }
+      else
+        delete_state_array(possible_states);
+
+      /* Only the thread working on a metastate touches its transitions */
+      for(i = d->csr->class_symbol[c]; i >= 0; i = d->csr->next_in_class[i])
+        add_transition(metastate, link_to, d->csr->symbols[i]);
+    }
+
+    atomic_fetch_sub(&d->pending, 1);
+  }
+
+  self->stats = thread_stats;
+
+  return NULL;
+}
+
+/* Find the metastate for a set of states, or make it if there isn't one */
+static struct State *intern_metastate(struct Determinizer *d,
+    struct Arena *arena, struct StateArray *states, int *made)
+{
+  /* The shard comes out of the top bits, the bucket out of the bottom ones */
+  int shard = (int) (hash_state_array(states) >> 58) & (NUM_SHARDS - 1);
+  struct State *metastate;
+
+  pthread_mutex_lock(&d->shard_locks[shard]);
+
+  metastate = find_metastate(d->shards[shard], states);
+  *made = (metastate == NULL);
+
+  if(*made)
+  {
+    metastate = new_metastate(arena, d->closures, states);
+    insert_metastate(d->shards[shard], metastate);
+  }
+
+  pthread_mutex_unlock(&d->shard_locks[shard]);
+
+  return metastate;
+}
+
+static void spend_shared_budget(struct Determinizer *d,
+    struct State *metastate)
+{
+  if(d->budget == NULL)
+    return;
+
+  pthread_mutex_lock(&d->budget_lock);
+
+  if(!spend_budget(d->budget, metastate_size(
+          (struct StateArray *) metastate->id, d->csr->num_symbols)))
+    atomic_store(&d->over_budget, 1);
+
+  pthread_mutex_unlock(&d->budget_lock);
+}
+
+static void push_work(struct WorkQueue *queue, struct State *metastate)
+{
+  pthread_mutex_lock(&queue->lock);
+
+  if(queue->bottom == queue->capacity)
+  {
+    /* Slide what's left down to the front, growing it if it's still full */
+    int i, count = queue->bottom - queue->top;
+
+    for(i = 0; i < count; i++)
+      queue->items[i] = queue->items[queue->top + i];
+
+    queue->top = 0;
+    queue->bottom = count;
+
+    if(count == queue->capacity)
+    {
+      queue->capacity *= 2;
+      queue->items = (struct State **) realloc(queue->items,
+          queue->capacity * sizeof(struct State *));
+    }
+  }
+
+  queue->items[queue->bottom++] = metastate;
+
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static struct State *pop_work(struct WorkQueue *queue)
+{
+  struct State *metastate = NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if(queue->bottom > queue->top)
+    metastate = queue->items[--queue->bottom];
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return metastate;
+}
+
+static struct State *steal_work(struct WorkQueue *queue)
+{
+  struct State *metastate = NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if(queue->bottom > queue->top)
+    metastate = queue->items[queue->top++];
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return metastate;
+}
+
+/* Add every state reachable from start to the DFA, breadth first, trying the
+ *  symbols in order. That's the order deterministic_fsm() makes them in.
+ */
+static void renumber_breadth_first(struct FSM *dfa, struct State *start,
+    struct CompiledNFA *csr)
+{
+  int next, i;
+
+  add_state(dfa, start);
+
+  for(next = 0; next < dfa->num_states; next++)
+  {
+    /* The worker arenas it pointed at are part of the DFA's now */
+    dfa->states[next]->arena = dfa->arena;
+
+    for(i = 0; i < csr->num_symbols; i++)
+    {
+      struct Transition *t =
+        transition_from_with_input(dfa->states[next], csr->symbols[i]);
+
+      /* Metastates fresh out of new_state() have no index yet */
+      if(t != NULL && t->to[0]->index == -1)
+        add_state(dfa, t->to[0]);
+    }
+  }
+}
@@ -0,0 +1,18 @@
+/* Headers for multi-threaded subset construction
+ */
+
+#ifndef __PARALLEL_DFSM_H__
+#define __PARALLEL_DFSM_H__
+
+/* Same as deterministic_fsm_within(), but with num_threads threads working
+ *  on the frontier of unexpanded metastates at once. budget can be NULL.
+ * The states are renumbered breadth first from the start state at the end,
+ *  so the result is the same automaton, in the same order, as
+ *  deterministic_fsm() makes, however the work got split up. Over budget,
+ *  the threads all stop where they are; which states they'd got to by then
+ *  is down to timing.
+ */
+struct FSM *parallel_deterministic_fsm(struct FSM *ndfa, void **alphabet,
+    int num_symbols, int num_threads, struct DeterminizeBudget *budget);
+
+#endif
@@ -0,0 +1,615 @@
+/*
+ * ranges.c | Transitions on ranges of bytes: naming them, reading them out
+ *  of regexps, and cutting them apart
+ *
+ * A class like [a-z] is one transition on one symbol, not 26 of them, so
+ *  NFAs stay as small as they'd be for a single character. The symbols are
+ *  interned like any other, under a name that says which bytes they're on,
+ *  and everything that needs to know reads it back from there.
+ * Determinizing needs every byte to be on just one symbol, though, so
+ *  before then ranges that overlap get cut at every place one of them starts
+ *  or stops, into pieces that don't.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "ranges.h"
+
+static int plain_byte(int byte);
+static int write_byte(int byte, char *name);
+static int read_byte(const char *name, int *byte);
+static int hex_digit(int c);
+static int parse_escape(const char *text, int *length);
+static int parse_class(const char *text, int *length,
+    struct ByteRange *ranges);
+static int normalize_ranges(struct ByteRange *ranges, int num_ranges);
+static int compare_ranges(const void *left, const void *right);
+static void mark_symbols(struct Transition *root, char *on_edge);
+static void **cut_ranges(struct SymbolTable *table, const char *on_edge,
+    int n, void ***alphabet, int *alphabet_size, int **ref_piece_start);
+static void collect_cut(struct Transition *root, int *piece_start, int n,
+    void ***symbols, int *num_symbols);
+
+void byte_range_name(int low, int high, char *name)
+{
+  name += write_byte(low, name);
+
+  if(high != low)
+  {
+    *name++ = '-';
+    name += write_byte(high, name);
+  }
+
+  *name = '\0';
+}
+
+int parse_byte_range_name(const char *name, int *low, int *high)
+{
+  int length;
+
+  if(name == NULL || (length = read_byte(name, low)) == 0)
+    return 0;
+
+  name += length;
+
+  if(*name == '\0')
+  {
+    *high = *low;
+    return 1;
+  }
+
+  if(*name != '-' || (length = read_byte(name + 1, high)) == 0 ||
+      name[length + 1] != '\0' || *high <= *low)
+    return 0;
+
+  return 1;
+}
+
+void *intern_range(struct SymbolTable *table, int low, int high,
+    void ***alphabet, int *alphabet_size)
+{
+  char name[BYTE_RANGE_NAME_SIZE];
+
+  byte_range_name(low, high, name);
+
+  int before = table->num_symbols;
+  void *symbol = intern_symbol(table, name);
+
+  /* If it's only just been interned, it's new to the alphabet too */
+  if(table->num_symbols != before)
+    add_if_not_present(alphabet, alphabet_size, symbol);
+
+  return symbol;
+}
+
+char *range_label(struct SymbolTable *table, void *symbol)
+{
+  if(symbol == EPSILON)
+    return strdup("&#949;");
+
+  /* Names can have backslashes in them, which dot would take as escapes,
+   *  and commas, which would look like they came between two symbols on an
+   *  edge
+   */
+  const char *name = symbol_name(table, symbol);
+  char *label = (char *) malloc( 5 * strlen(name) + 1 ), *cur = label;
+
+  for(; *name; name++)
+  {
+    if(*name == ',')
+    {
+      strcpy(cur, "\\\\x2c");
+      cur += 5;
+      continue;
+    }
+
+    if(*name == '\\')
+      *cur++ = '\\';
+    *cur++ = *name;
+  }
+
+  *cur = '\0';
+
+  return label;
+}
+
+int parse_atom(const char *text, int *length, struct ByteRange *ranges)
+{
+  int byte;
+
+  switch(text[0])
+  {
+    case '\0': case '\n': case ' ': case '\t':
+    case '|': case '*': case '(': case ')': case ']':
+      return -1;
+
+    case '.':
+      /* Anything but a newline */
+      ranges[0].low = 0;
+      ranges[0].high = '\n' - 1;
+      ranges[1].low = '\n' + 1;
+      ranges[1].high = 255;
+      *length = 1;
+      return 2;
+
+    case '[':
+      return parse_class(text, length, ranges);
+
+    case '\\':
+      if((byte = parse_escape(text, length)) < 0)
+        return -1;
+      break;
+
+    default:
+      byte = (unsigned char) text[0];
+      *length = 1;
+  }
+
+  ranges[0].low = ranges[0].high = byte;
+
+  return 1;
+}
+
+int split_ranges(struct FSM *nfa, struct SymbolTable *table,
+    void ***alphabet, int *alphabet_size)
+{
+  int n = table->num_symbols, i, j, k, num_split = 0;
+
+  /* Which symbols are on transitions at all; the alphabet can have ones
+   *  that were only on other regexps' transitions
+   */
+  char *on_edge = (char *) calloc( n, sizeof(char) );
+
+  for(i = 0; i < nfa->num_states; i++)
+    if(nfa->states[i]->transitions_tree != NULL)
+      mark_symbols(nfa->states[i]->transitions_tree, on_edge);
+
+  int *piece_start;
+  void **pieces = cut_ranges(table, on_edge, n, alphabet, alphabet_size,
+      &piece_start);
+
+  void **symbols;
+  struct State **to = NULL;
+  int num_symbols, num_to, capacity = 0;
+
+  for(i = 0; i < nfa->num_states && piece_start[n] > 0; i++)
+  {
+    struct State *state = nfa->states[i];
+
+    if(state->transitions_tree == NULL)
+      continue;
+
+    /* Gather them up first, since they're about to change under us */
+    symbols = NULL;
+    num_symbols = 0;
+    collect_cut(state->transitions_tree, piece_start, n, &symbols,
+        &num_symbols);
+
+    for(j = 0; j < num_symbols; j++)
+    {
+      struct Transition *t = transition_from_with_input(state, symbols[j]);
+      int id = SYMBOL_ID(symbols[j]);
+
+      num_to = t->num_to;
+
+      if(num_to > capacity)
+      {
+        capacity = num_to;
+        to = (struct State **) realloc(to, capacity * sizeof(struct State *));
+      }
+
+      memcpy(to, t->to, num_to * sizeof(struct State *));
+
+      for(k = 0; k < num_to; k++)
+      {
+        int p;
+
+        delete_transition(state, to[k], symbols[j]);
+
+        for(p = piece_start[id]; p < piece_start[id + 1]; p++)
+          add_transition(state, to[k], pieces[p]);
+      }
+
+      num_split++;
+    }
+
+    free(symbols);
+  }
+
+  free(on_edge);
+  free(piece_start);
+  free(pieces);
+  free(to);
+
+  return num_split;
+}
+
+void intern_pieces(struct SymbolTable *table, void **symbols,
+    int num_symbols, void ***alphabet, int *alphabet_size)
+{
+  int n = table->num_symbols, i, *piece_start;
+  char *on_edge = (char *) calloc( n, sizeof(char) );
+
+  for(i = 0; i < num_symbols; i++)
+    if(symbols[i] != NULL)
+      on_edge[SYMBOL_ID(symbols[i])] = 1;
+
+  free(cut_ranges(table, on_edge, n, alphabet, alphabet_size, &piece_start));
+  free(on_edge);
+  free(piece_start);
+}
+
+int usable_alphabet(struct FSM *nfa, struct SymbolTable *table,
+    void **alphabet, int alphabet_size, void ***ref_symbols)
+{
+  int n = table->num_symbols, i, b, low, high, count = 0;
+  char *on_edge = (char *) calloc( n, sizeof(char) );
+  char covered[256];
+
+  for(i = 0; i < nfa->num_states; i++)
+    if(nfa->states[i]->transitions_tree != NULL)
+      mark_symbols(nfa->states[i]->transitions_tree, on_edge);
+
+  /* Every byte that goes somewhere from somewhere */
+  memset(covered, 0, sizeof(covered));
+
+  for(i = 1; i < n; i++)
+    if(on_edge[i] &&
+        parse_byte_range_name(symbol_name(table, ID_SYMBOL(i)), &low, &high))
+      memset(covered + low, 1, high - low + 1);
+
+  void **symbols = (void **) malloc( (alphabet_size + 1) * sizeof(void *) );
+
+  for(i = 0; i < alphabet_size; i++)
+  {
+    int id = SYMBOL_ID(alphabet[i]);
+
+    if(id > 0 && id < n && !on_edge[id] &&
+        parse_byte_range_name(symbol_name(table, alphabet[i]), &low, &high))
+    {
+      for(b = low; b <= high && !covered[b]; b++)
+        ;
+
+      if(b <= high)
+        continue;
+    }
+
+    symbols[count++] = alphabet[i];
+  }
+
+  free(on_edge);
+
+  *ref_symbols = symbols;
+
+  return count;
+}
+
+/*
+ * Work out which of the first n symbols, of those that are on_edge, have to
+ *  be cut up, and intern the pieces each goes into, one symbol after another
+ *  by number. Symbol i's pieces are returned from (*ref_piece_start)[i] up
+ *  to (*ref_piece_start)[i + 1]; there are none if it stays as it is.
+ */
+static void **cut_ranges(struct SymbolTable *table, const char *on_edge,
+    int n, void ***alphabet, int *alphabet_size, int **ref_piece_start)
+{
+  int *piece_start = (int *) malloc( (n + 1) * sizeof(int) );
+  void **pieces = NULL;
+  int i, b, k, low, high, num_pieces = 0, capacity = 0;
+  char name[BYTE_RANGE_NAME_SIZE];
+
+  /* Wherever one of them starts, or one stops just before */
+  char cut[257];
+  memset(cut, 0, sizeof(cut));
+
+  for(i = 1; i < n; i++)
+    if(on_edge[i] &&
+        parse_byte_range_name(symbol_name(table, ID_SYMBOL(i)), &low, &high))
+    {
+      cut[low] = 1;
+      cut[high + 1] = 1;
+    }
+
+  piece_start[0] = 0;
+
+  for(i = 0; i < n; i++)
+  {
+    piece_start[i + 1] = num_pieces;
+
+    if(i == 0 || !on_edge[i] ||
+        !parse_byte_range_name(symbol_name(table, ID_SYMBOL(i)), &low, &high))
+      continue;
+
+    /* A range that's cut somewhere after its first byte overlaps another */
+    for(b = low + 1; b <= high && !cut[b]; b++)
+      ;
+
+    if(b > high)
+      continue;
+
+    for(b = low; b <= high; b = k)
+    {
+      for(k = b + 1; k <= high && !cut[k]; k++)
+        ;
+
+      if(num_pieces == capacity)
+      {
+        capacity = capacity ? 2 * capacity : 64;
+        pieces = (void **) realloc(pieces, capacity * sizeof(void *));
+      }
+
+      byte_range_name(b, k - 1, name);
+      pieces[num_pieces] = intern_symbol(table, name);
+      add_if_not_present(alphabet, alphabet_size, pieces[num_pieces++]);
+    }
+
+    piece_start[i + 1] = num_pieces;
+  }
+
+  *ref_piece_start = piece_start;
+
+  return pieces;
+}
+
+/* Can a byte go into a name as it is? */
+static int plain_byte(int byte)
+{
+  return byte > ' ' && byte < 127 && byte != '\\' && byte != '"' &&
+    byte != '&';
+}
+
+static int write_byte(int byte, char *name)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  if(plain_byte(byte))
+  {
+    name[0] = (char) byte;
+    return 1;
+  }
+
+  name[0] = '\\';
+  name[1] = 'x';
+  name[2] = hex[byte >> 4];
+  name[3] = hex[byte & 15];
+
+  return 4;
+}
+
+/* Read one byte of a name, returning how long it was, or 0 if it wasn't
+ *  written the way write_byte() would have
+ */
+static int read_byte(const char *name, int *byte)
+{
+  if(plain_byte((unsigned char) name[0]))
+  {
+    *byte = (unsigned char) name[0];
+    return 1;
+  }
+
+  if(name[0] != '\\' || name[1] != 'x' || hex_digit(name[2]) < 0 ||
+      hex_digit(name[3]) < 0)
+    return 0;
+
+  *byte = 16 * hex_digit(name[2]) + hex_digit(name[3]);
+
+  return plain_byte(*byte) ? 0 : 4;
+}
+
+static int hex_digit(int c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
+}
+
+/* The byte an escape starting at text stands for, or -1 if it's malformed */
+static int parse_escape(const char *text, int *length)
+{
+  *length = 2;
+
+  switch(text[1])
+  {
+    /* Nothing escapes the end of the line */
+    case '\0':
+    case '\n':
+      return -1;
+
+    case 'n':
+      return '\n';
+
+    case 't':
+      return '\t';
+
+    case 'r':
+      return '\r';
+
+    case 'x':
+      if(hex_digit(text[2]) < 0 || hex_digit(text[3]) < 0)
+        return -1;
+
+      *length = 4;
+      return 16 * hex_digit(text[2]) + hex_digit(text[3]);
+
+    default:
+      return (unsigned char) text[1];
+  }
+}
+
+static int parse_class(const char *text, int *length,
+    struct ByteRange *ranges)
+{
+  int i = 1, negated = 0, num_ranges = 0, low, high, size;
+  struct ByteRange all[256];
+
+  if(text[i] == '^')
+  {
+    negated = 1;
+    i++;
+  }
+
+  /* A "]" straight away is just a "]" */
+  if(text[i] == ']')
+  {
+    all[num_ranges].low = all[num_ranges].high = ']';
+    num_ranges++;
+    i++;
+  }
+
+  while(text[i] != ']')
+  {
+    if(text[i] == '\0' || text[i] == '\n')
+      return -1;
+
+    if(text[i] == '\\')
+    {
+      if((low = parse_escape(text + i, &size)) < 0)
+        return -1;
+    }
+    else
+    {
+      low = (unsigned char) text[i];
+      size = 1;
+    }
+
+    i += size;
+    high = low;
+
+    /* A "-" with something after it (that isn't the end) makes a range */
+    if(text[i] == '-' && text[i + 1] != ']' && text[i + 1] != '\0')
+    {
+      i++;
+
+      if(text[i] == '\\')
+      {
+        if((high = parse_escape(text + i, &size)) < 0)
+          return -1;
+      }
+      else
+      {
+        high = (unsigned char) text[i];
+        size = 1;
+      }
+
+      i += size;
+
+      if(high < low)
+        return -1;
+    }
+
+    /* Only 256 bytes to go round, however they're written */
+    if(num_ranges == 256)
+      num_ranges = normalize_ranges(all, num_ranges);
+
+    all[num_ranges].low = low;
+    all[num_ranges].high = high;
+    num_ranges++;
+  }
+
+  *length = i + 1;
+
+  num_ranges = normalize_ranges(all, num_ranges);
+
+  if(!negated)
+  {
+    memcpy(ranges, all, num_ranges * sizeof(struct ByteRange));
+    return num_ranges;
+  }
+
+  /* Everything in the gaps, but never a newline, as with "." */
+  int count = 0, next = 0;
+
+  all[num_ranges].low = all[num_ranges].high = '\n';
+  num_ranges = normalize_ranges(all, num_ranges + 1);
+
+  for(i = 0; i < num_ranges; i++)
+  {
+    if(all[i].low > next)
+    {
+      ranges[count].low = next;
+      ranges[count++].high = all[i].low - 1;
+    }
+
+    next = all[i].high + 1;
+  }
+
+  if(next <= 255)
+  {
+    ranges[count].low = next;
+    ranges[count++].high = 255;
+  }
+
+  return count;
+}
+
+/* Sort ranges, and put together the ones that overlap or touch */
+static int normalize_ranges(struct ByteRange *ranges, int num_ranges)
+{
+  int i, count = 0;
+
+  qsort(ranges, num_ranges, sizeof(struct ByteRange), compare_ranges);
+
+  for(i = 0; i < num_ranges; i++)
+  {
+    if(count > 0 && ranges[i].low <= ranges[count - 1].high + 1)
+    {
+      if(ranges[i].high > ranges[count - 1].high)
+        ranges[count - 1].high = ranges[i].high;
+    }
+    else
+      ranges[count++] = ranges[i];
+  }
+
+  return count;
+}
+
+static int compare_ranges(const void *left, const void *right)
+{
+  int l = ((const struct ByteRange *) left)->low;
+  int r = ((const struct ByteRange *) right)->low;
+
+  return (l > r) - (l < r);
+}
+
+static void mark_symbols(struct Transition *root, char *on_edge)
+{
+  if(root->left != NULL)
+    mark_symbols(root->left, on_edge);
+
+  if(root->value != NULL && root->num_to > 0)
+    on_edge[SYMBOL_ID(root->value)] = 1;
+
+  if(root->right != NULL)
+    mark_symbols(root->right, on_edge);
+}
+
+/* The symbols of a tree that have to be cut up, out of the first n */
+static void collect_cut(struct Transition *root, int *piece_start, int n,
+    void ***symbols, int *num_symbols)
+{
+  int id = SYMBOL_ID(root->value);
+
+  if(root->left != NULL)
+    collect_cut(root->left, piece_start, n, symbols, num_symbols);
+
+  if(id > 0 && id < n && root->num_to > 0 &&
+      piece_start[id + 1] > piece_start[id])
+  {
+    *symbols = (void **) realloc(*symbols,
+        (*num_symbols + 1) * sizeof(void *));
+    (*symbols)[(*num_symbols)++] = root->value;
+  }
+
+  if(root->right != NULL)
+    collect_cut(root->right, piece_start, n, symbols, num_symbols);
+}
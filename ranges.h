@@ -0,0 +1,91 @@
+/* Headers for transitions on ranges of bytes
+ */
+
+#ifndef __RANGES_H__
+#define __RANGES_H__
+
+/* The most ranges one atom of a regexp can stand for: every other byte */
+#define MAX_BYTE_RANGES 128
+
+/* Longest name a range's symbol can have, counting the '\0' */
+#define BYTE_RANGE_NAME_SIZE 10
+
+/* Every byte from low up to high */
+struct ByteRange
+{
+  int low;
+  int high;
+};
+
+/*
+ * A symbol stands for a range of bytes by its name, which is the first
+ *  byte, and then if there's more than one, "-" and the last byte, as in
+ *  "a" or "a-z". Bytes that aren't plain to see, or that would need quoting
+ *  somewhere (blanks, '"', '&', '\' and anything outside ASCII), are written
+ *  as "\x" and two hex digits, as in "\x00-\x1f".
+ * Every range has just the one name, so interning it makes the same symbol
+ *  for the same range every time.
+ */
+void byte_range_name(int low, int high, char *name);
+
+/* Read a name back, returning 0 if it isn't the name of a range */
+int parse_byte_range_name(const char *name, int *low, int *high);
+
+/* The symbol for a range of bytes, interned in table, and put in the
+ *  alphabet if it's new. Symbols outlive the regexp they first turn up in,
+ *  since the alphabet keeps them.
+ */
+void *intern_range(struct SymbolTable *table, int low, int high,
+    void ***alphabet, int *alphabet_size);
+
+/* A symbol's name, in a new string, the way dot has to be given it in a
+ *  label: with its backslashes doubled, its commas as "\x2c" (an edge's
+ *  symbols are listed with commas between them), and EPSILON as an epsilon
+ */
+char *range_label(struct SymbolTable *table, void *symbol);
+
+/*
+ * Read one atom of a regexp: a character, an escape ("\n", "\t", "\r",
+ *  "\x" with two hex digits, or "\" before anything but a newline to take
+ *  it as it is), "." for any byte but a newline, or a class in brackets such as
+ *  "[a-z_]" or "[^0-9]". A class's "]" can come first, and "-" first or
+ *  last, to be taken as themselves; "[^...]" never takes in a newline.
+ * The bytes it stands for go into ranges, sorted and with none touching,
+ *  and how much of text it took up into *length. Returns how many ranges
+ *  there are, or -1 if text doesn't start with an atom (it's "|", "*",
+ *  "(", ")", a blank, a newline or the end, or it's malformed).
+ */
+int parse_atom(const char *text, int *length, struct ByteRange *ranges);
+
+/*
+ * Cut the ranges an NFA's transitions are on into pieces that don't
+ *  overlap, wherever two of them do, so that each byte is on only one of
+ *  an NFA's symbols. Determinizing needs that, and so does anything
+ *  that goes from bytes to symbols, such as lazy DFAs and DFA tables.
+ *  Symbols that already don't overlap are left be.
+ * A transition on a range that's cut up is replaced by one on each piece.
+ *  The pieces are interned in table, and any that are new are put in the
+ *  alphabet. Returns how many transitions were cut up.
+ */
+int split_ranges(struct FSM *nfa, struct SymbolTable *table,
+    void ***alphabet, int *alphabet_size);
+
+/*
+ * The part of an alphabet that an NFA, once its ranges are cut up, can be
+ *  determinized over: all of it but the symbols that aren't on any of its
+ *  transitions and share a byte with one that is. Those would have the DFA
+ *  say their bytes go nowhere, when some of them go somewhere.
+ * What's left goes into a new array in *ref_symbols, in the same order.
+ *  Returns how much of it there is.
+ */
+int usable_alphabet(struct FSM *nfa, struct SymbolTable *table,
+    void **alphabet, int alphabet_size, void ***ref_symbols);
+
+/* Intern the pieces split_ranges() would cut symbols up into if they were
+ *  what an NFA's transitions were on, in the same order, putting any that
+ *  are new in the alphabet, without an NFA to cut up
+ */
+void intern_pieces(struct SymbolTable *table, void **symbols,
+    int num_symbols, void ***alphabet, int *alphabet_size);
+
+#endif
@@ -3,20 +3,144 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <unistd.h>
+#include <getopt.h>
+
 #include "fsm.h"
 #include "dot_output.h"
 #include "dfsm.h"
+#include "parallel_dfsm.h"
+#include "minimize.h"
+#include "matcher.h"
+#include "lazy_dfa.h"
+#include "stream.h"
+#include "batch.h"
+#include "cache.h"
+#include "dfa_table.h"
+#include "dfa_file.h"
+#include "stats.h"
+#include "simplify.h"
+#include "ranges.h"
 
 void **alphabet;
 int alphabet_size = 0;
 
+/* Every symbol's name, by number */
+struct SymbolTable *symbol_table = NULL;
+
 int input_number = 0;
 
+/* Everything for the regexp being read comes out of here */
+struct Arena *arena;
+
+/* How many threads to determinize with, from -j */
+int num_threads = 1;
+
+/* How big any one regexp's DFA may get, from -L (states) and -M (megabytes).
+ *  A regexp whose DFA would be bigger has its NFA drawn instead.
+ */
+int max_dfa_states = 0;
+size_t max_dfa_bytes = DFA_DEFAULT_MAX_BYTES;
+
+/* How much memory the lazy DFA that -e and -m scan with may keep its states
+ *  in before it throws them away and starts over, from -B (megabytes)
+ */
+size_t lazy_dfa_bytes = LAZY_DFA_DEFAULT_BUDGET;
+
+/* Given -g, NFAs are Glushkov automata (see glushkov_union()) rather than
+ *  Thompson's
+ */
+int glushkov = 0;
+
+/* Report state counts on stderr, from -v */
+int verbose = 0;
+
+/* Given --stats, a line of JSON on stderr for each regexp about what went
+ *  into it, phase by phase
+ */
+int show_stats = 0;
+
+/* Given -e, the one regexp to scan the input files with, grep style, instead
+ *  of reading regexps from stdin and drawing them
+ */
+char *pattern = NULL;
+char **input_files;
+int num_input_files;
+int lines_matched = 0;
+
+/* Given -x as well, only lines the regexp matches all of, as with grep -x */
+int whole_lines = 0;
+
+/* Given -m, all the regexps put together into one automaton, each of them
+ *  a pattern numbered by which line it was on
+ */
+int multiple = 0;
+struct FSM *combined = NULL;
+
+/* Given -o as well, where the DFA for all of them gets written as a table */
+char *table_file = NULL;
+
+/* Given -t, a table written with -o to match the input files with, rather
+ *  than reading any regexps
+ */
+char *match_table = NULL;
+
+/* A regexp to draw: its NFA, to be compiled with the alphabet as it was
+ *  when the regexp was read, or else the DFA the cache had for it. Given a
+ *  key, whatever the NFA compiles to gets cached under it, and given a table
+ *  file, written there as a table too. Its stats so far are carried along,
+ *  since it might get drawn on another thread, along with what simplifying
+ *  its NFA did, for -v.
+ */
+struct Drawing
+{
+  struct FSM *nfa;
+  struct FSM *cached;
+  int alphabet_size;
+  char *cache_key;
+  char *table_file;
+  struct Stats stats;
+  struct SimplifyReport simplified;
+};
+
+/* Given -b, every regexp, kept (each in its own arena) till they've all
+ *  been read, then drawn -j at a time. They come out just like they do one
+ *  by one.
+ * Reading them stays serial. The parser and lexer keep their state in
+ *  globals, and each regexp's DFA is numbered by the alphabet as it was
+ *  when that regexp was read, which only reading them in order gives.
+ *  Parsing and building the NFAs is the small part of it anyway.
+ */
+int batch = 0;
+struct Drawing *batch_items = NULL;
+int num_batch_items = 0;
+
+/* Given -C, where DFAs are kept from one run to the next, and the key for
+ *  the regexp being parsed
+ */
+struct CompileCache *cache = NULL;
+char *cache_key = NULL;
+
+extern FILE *yyin;
+void yyrestart(FILE *file);
+void *alphabet_range(int low, int high);
+
 char *symbol_string(void *value);
+int symbol_bytes(void *value, int *low, int *high);
 char *id_string(void *id);
 char *meta_id_string(void *id);
 
-int test_string(struct FSM *fsm, char *string);
+void test_lines(struct FSM *fsm);
+void draw_regexp(struct Drawing *drawing);
+void write_automata(struct Drawing *drawing, char *name, int threads,
+    FILE *log);
+void write_batch_item(void *item, int index, FILE *out);
+int read_with_cache(void);
+char *cache_key_for(char *line);
+void scan_inputs(struct FSM *fsm);
+void start_regexp(void);
+int match_table_inputs(struct DFATable *table);
+void report_simplified(FILE *log, char *name, struct SimplifyReport *report);
 %}
 
 %union {
@@ -34,119 +158,762 @@ regular_expression_list: regular_expression '\n'
                        | regular_expression_list regular_expression '\n'
                        ;
 
-regular_expression     : option   { struct FSM *fsm = $1;
-                                    int i, digits, temp;
-                                    char *s;
+regular_expression     : option   { struct SimplifyReport simplified;
 
                                     input_number++;
-                                    temp = input_number;
-                                    for(digits = 1; temp /= 10; digits++);
-
-                                    s = (char *) malloc((digits + 5) *
-                                      sizeof(char));
-                                    sprintf(s, "%i.dot", input_number);
-
-                                    FILE *file = fopen(s, "w");
-                                    
-                                    free(s);
- 
-                                    for(i = 0; i < fsm->num_states; i++)
+                                    STATS_STOP(STATS_PARSE);
+
+                                    /* Whatever's done with it next, it's
+                                     *  quicker done with less of it
+                                     */
+                                    simplify_fsm($1, &simplified);
+
+                                    /* Classes like [a-z] and [aeiou]
+                                     *  can't share bytes once it's
+                                     *  determinized
+                                     */
+                                    split_ranges($1, symbol_table, &alphabet,
+                                        &alphabet_size);
+
+                                    if(multiple)
                                     {
-                                      temp = i;
-                                      for(digits = 1; temp /= 10; digits++);
-                                      s = (char *) malloc((digits + 2) *
-                                        sizeof(char));
-                                      sprintf(s, "s%i", i);
-                                      fsm->states[i]->id = s;
+                                      char name[32];
+
+                                      sprintf(name, "regexp %i", input_number);
+
+                                      if(verbose)
+                                        report_simplified(stderr, name,
+                                            &simplified);
+
+                                      /* Hang on to it till they're all in */
+                                      label_fsm($1, input_number);
+                                      if(combined == NULL)
+                                        combined = $1;
+                                      else if(glushkov)
+                                        combined = glushkov_union(combined,
+                                            $1);
+                                      else
+                                        combined = fsmunion_patterns(combined,
+                                            $1);
+                                      STATS_START(STATS_PARSE);
                                     }
-                             
-                                    struct FSM *dfa =
-                                      deterministic_fsm(fsm, alphabet,
-                                      alphabet_size);
- 
-                                    for(i = 0; i < dfa->num_states; i++)
+                                    else if(pattern != NULL)
                                     {
-                                      int digits, temp = i;
-                                      for(digits = 1; temp /= 10; digits++);
-                                      s = (char *) malloc((digits + 2) *
-                                        sizeof(char));
-                                      sprintf(s, "s%i", i);
-                                      dfa->states[i]->id = s;
+                                      if(verbose)
+                                        report_simplified(stderr, pattern,
+                                            &simplified);
+
+                                      if(whole_lines)
+                                        test_lines($1);
+                                      else
+                                        scan_inputs($1);
+
+                                      if(show_stats)
+                                        fprint_stats(stderr, pattern,
+                                            &thread_stats, arena);
+
+                                      /* The NFA and everything made from
+                                       *  it, all at once. The lexer has yet
+                                       *  to read the next regexp, so it
+                                       *  gets a fresh arena.
+                                       */
+                                      delete_arena(arena);
+                                      arena = new_arena();
+                                    }
+                                    else
+                                    {
+                                      struct Drawing drawing = {
+                                        .nfa = $1,
+                                        .alphabet_size = alphabet_size,
+                                        .cache_key = cache_key };
+
+                                      drawing.stats = thread_stats;
+                                      drawing.simplified = simplified;
+                                      cache_key = NULL;
+                                      draw_regexp(&drawing);
                                     }
- 
-                                    fprint_fsm(file, fsm,
-                                      symbol_string, id_string);
                                   }
                        ;
 
 option                 : option '|' sequence { struct FSM *left = $1;
                                                struct FSM *right = $3; 
-                                               $$ = fsmunion(left, right);
-                                               free(left);
-                                               free(right);
+                                               $$ = glushkov ?
+                                                 glushkov_union(left, right) :
+                                                 fsmunion(left, right);
                                              }
-                       | sequence            { $$ = $1 }
+                       | sequence            { $$ = $1; }
                        ;
 
 sequence               : sequence subexp     { struct FSM *left = $1;
                                                struct FSM *right = $2; 
-                                               $$ = fsmcat(left, right);
-                                               free(left);
-                                               free(right);
+                                               $$ = glushkov ?
+                                                 glushkov_cat(left, right) :
+                                                 fsmcat(left, right);
                                              }
-                       | subexp              { $$ = $1 }
+                       | subexp              { $$ = $1; }
                        ;
 
-subexp                 : '(' option ')'      { $$ = $2 }
+subexp                 : '(' option ')'      { $$ = $2; }
                        | subexp '*'          { struct FSM *fsm = $1;
-                                               $$ = fsmclosure(fsm);
-                                               free(fsm);
+                                               $$ = glushkov ?
+                                                 glushkov_closure(fsm) :
+                                                 fsmclosure(fsm);
                                              }
-                       | CHARACTER           { $$ = $1 }
+                       | CHARACTER           { $$ = $1; }
                        ;
 
 %%
 
-int test_string(struct FSM *fsm, char *string)
+int main(int argc, char **argv)
 {
-  char *cur = string;
+  static struct option long_options[] =
+  {
+    { "stats", no_argument, NULL, 'S' },
+    { NULL, 0, NULL, 0 }
+  };
+  int option;
+
+  while((option = getopt_long(argc, argv, "j:ve:xmgbC:o:t:L:M:B:", long_options,
+          NULL)) != -1)
+  {
+    if(option == 'j' && atoi(optarg) > 0)
+      num_threads = atoi(optarg);
+    else if(option == 'L' && atoi(optarg) >= 0)
+      max_dfa_states = atoi(optarg);
+    else if(option == 'M' && atol(optarg) >= 0)
+      max_dfa_bytes = (size_t) atol(optarg) << 20;
+    else if(option == 'B' && atol(optarg) > 0)
+      lazy_dfa_bytes = (size_t) atol(optarg) << 20;
+    else if(option == 'v')
+      verbose = 1;
+    else if(option == 'e')
+      pattern = optarg;
+    else if(option == 'x')
+      whole_lines = 1;
+    else if(option == 'm')
+      multiple = 1;
+    else if(option == 'g')
+      glushkov = 1;
+    else if(option == 'b')
+      batch = 1;
+    else if(option == 'o')
+      table_file = optarg;
+    else if(option == 't')
+      match_table = optarg;
+    else if(option == 'S')
+    {
+      if(stats_enabled())
+        show_stats = 1;
+      else
+        fprintf(stderr, "%s: built with NO_STATS, so there are none\n",
+            argv[0]);
+    }
+    else if(option == 'C')
+    {
+      cache = open_compile_cache(optarg, CACHE_DEFAULT_MAX_BYTES);
+
+      if(cache == NULL)
+        fprintf(stderr, "%s: can't use %s as a cache\n", argv[0], optarg);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-v] [--stats] [-g] [-j threads] [-b] "
+          "[-C cache]\n"
+          "       %*s [-L states] [-M megabytes]\n"
+          "       %s [-v] [--stats] [-g] [-j threads] [-B megabytes] [-x] "
+          "-e regexp [file ...]\n"
+          "       %s [-v] [--stats] [-g] [-j threads] [-B megabytes] -m "
+          "[-o table] [file ...]\n"
+          "       %s -t table [file ...]\n",
+          argv[0], (int) strlen(argv[0]), "", argv[0], argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  input_files = argv + optind;
+  num_input_files = argc - optind;
+
+  /* Made up front, not by the first character read, so that nothing that
+   *  looks symbols up has to wonder whether there's a table yet
+   */
+  symbol_table = new_symbol_table();
+
+  if(match_table != NULL)
+  {
+    struct DFATable *table = map_dfa_table(match_table);
+
+    if(table == NULL)
+    {
+      fprintf(stderr, "%s: %s isn't a table\n", argv[0], match_table);
+      return 2;
+    }
 
-  struct StateArray *possible_states = (struct StateArray *)
-    malloc( sizeof(struct StateArray *) );
+    int result = match_table_inputs(table);
 
-  possible_states->states = (struct State **)
-    malloc( 1 * sizeof(struct State *) );
+    delete_dfa_table(table);
 
-  possible_states->states[0] = fsm->start_state;
-  possible_states->num_states = 1;
+    return result ? 2 : (lines_matched ? 0 : 1);
+  }
 
-  int i, j;
+  arena = new_arena();
+  start_regexp();
 
-  epsilon_closure(&possible_states->states, &possible_states->num_states);
+  if(multiple)
+  {
+    int result = yyparse();
+
+    if(result || combined == NULL)
+      return 2;
+
+    /* Each regexp's ranges were cut up on their own, but not against each
+     *  other's
+     */
+    split_ranges(combined, symbol_table, &alphabet, &alphabet_size);
+
+    /* One pass over each file for every pattern at once, or else one
+     *  drawing of them all
+     */
+    if(num_input_files > 0)
+    {
+      scan_inputs(combined);
+
+      if(show_stats)
+        fprint_stats(stderr, "all", &thread_stats, arena);
+
+      /* Like grep: whether any line matched */
+      return lines_matched ? 0 : 1;
+    }
+    else
+    {
+      struct Drawing drawing = { .nfa = combined,
+        .alphabet_size = alphabet_size, .table_file = table_file };
+
+      drawing.stats = thread_stats;
+      write_automata(&drawing, "all.dot", num_threads, stderr);
+
+      return 0;
+    }
+  }
 
-  do
+  if(pattern == NULL)
   {
-    char temp[2];
-    sprintf(temp, "%c", *cur);
+    int result = (cache != NULL) ? read_with_cache() : yyparse();
 
-    possible_states = possible_states_from(possible_states, temp);
+    if(batch)
+    {
+      /* Every regexp at once, rather than each on every thread in turn.
+       *  Whatever they've got to say comes out in order regardless.
+       */
+      void **items = (void **) malloc( num_batch_items * sizeof(void *) );
+      int i;
 
-  } while(*(++cur) != '\0');
+      for(i = 0; i < num_batch_items; i++)
+        items[i] = &batch_items[i];
 
+      run_batch(items, num_batch_items, write_batch_item, num_threads,
+          stderr);
 
-  for(i = 0; i < possible_states->num_states; i++)
-    if(possible_states->states[i]->accepting)
-      return 1;
+      free(items);
+      free(batch_items);
+    }
+
+    if(cache != NULL)
+    {
+      if(verbose)
+        fprintf(stderr, "%ld of %ld regexps came from the cache\n",
+            cache->hits, cache->hits + cache->misses);
+
+      close_compile_cache(cache);
+    }
+
+    return result;
+  }
+
+  /* The parser wants its regexps a line at a time */
+  char *line = (char *) malloc( strlen(pattern) + 2 );
+  sprintf(line, "%s\n", pattern);
+  yyin = fmemopen(line, strlen(line), "r");
+
+  int result = yyparse();
 
-  return 0;
+  fclose(yyin);
+  free(line);
+
+  /* Like grep: 0 if anything matched, 1 if not, 2 if something went wrong */
+  return result ? 2 : (lines_matched ? 0 : 1);
 }
 
-char *symbol_string(void *value)
+/* Draw a regexp, unless it's a batch, in which case put it off till the
+ *  end. Either way, the arena it's in is done with here, so the next regexp
+ *  gets a fresh one.
+ */
+void draw_regexp(struct Drawing *drawing)
 {
-  if(value == EPSILON)
-    return strdup("&#949;");
+  if(batch)
+  {
+    batch_items = (struct Drawing *) realloc(batch_items,
+        (num_batch_items + 1) * sizeof(struct Drawing));
+    batch_items[num_batch_items++] = *drawing;
+  }
   else
-    return strdup((char *) value);
+  {
+    char name[16];
+    sprintf(name, "%i.dot", input_number);
+
+    write_automata(drawing, name, num_threads, stderr);
+
+    /* The NFA, any DFAs and their ids, all at once */
+    free(drawing->cache_key);
+    delete_arena(arena);
+  }
+
+  arena = new_arena();
+  start_regexp();
+}
+
+/* Start counting (and timing the parse) for the next regexp */
+void start_regexp(void)
+{
+  reset_stats(&thread_stats);
+  STATS_START(STATS_PARSE);
+}
+
+/* Determinize (on some number of threads) and minimize a regexp's NFA, or
+ *  take the DFA the cache had for it, and draw the result into a .dot file.
+ *  If the DFA would go over budget, the NFA gets drawn instead, and that's
+ *  all that happens to it.
+ *  Accepting states are labelled with the patterns they're for, if there
+ *  are any. With -v, say how big it all got on log.
+ * Everything comes out of the automaton's own arena, so automata in
+ *  different arenas can be drawn at the same time.
+ */
+void write_automata(struct Drawing *drawing, char *name, int threads,
+    FILE *log)
+{
+  struct FSM *fsm = drawing->nfa, *min = drawing->cached;
+  struct Arena *arena = (min != NULL) ? min->arena : fsm->arena;
+  int i, j, digits, temp;
+  char *s;
+
+  /* Carry on counting from where parsing left off, on whatever thread */
+  thread_stats = drawing->stats;
+
+  FILE *file = fopen(name, "w");
+
+  if(min == NULL)
+  {
+    if(verbose && drawing->simplified.states_before > 0)
+      report_simplified(log, name, &drawing->simplified);
+
+    for(i = 0; i < fsm->num_states; i++)
+    {
+      temp = i;
+      for(digits = 1; temp /= 10; digits++);
+      s = (char *) arena_alloc(arena, (digits + 2) * sizeof(char));
+      sprintf(s, "s%i", i);
+      fsm->states[i]->id = s;
+    }
+
+    /* Leaving out the ranges that were cut up, or that overlap this one's */
+    void **symbols;
+    int num_symbols = usable_alphabet(fsm, symbol_table, alphabet,
+        drawing->alphabet_size, &symbols);
+
+    struct DeterminizeBudget budget = { .max_states = max_dfa_states,
+      .max_bytes = max_dfa_bytes };
+    struct FSM *dfa = parallel_deterministic_fsm(fsm, symbols, num_symbols,
+        threads, &budget);
+
+    free(symbols);
+
+    if(dfa == NULL)
+    {
+      fprintf(log, "%s: gave up on the DFA at %i states and %lu bytes, so "
+          "it's the NFA\n", name, budget.num_states,
+          (unsigned long) budget.bytes_used);
+
+      min = fsm;
+    }
+    else
+    {
+      min = minimize_fsm(dfa);
+
+      if(verbose)
+        fprintf(log, "%s: %i DFA states, %i after minimization, "
+            "%lu bytes in %ld allocations\n", name, dfa->num_states,
+            min->num_states, (unsigned long) arena->bytes_used,
+            arena->num_allocations);
+
+      if(cache != NULL && drawing->cache_key != NULL)
+        compile_cache_store(cache, drawing->cache_key, min, symbol_table);
+    }
+  }
+  else if(verbose)
+    fprintf(log, "%s: %i states, from the cache\n", name, min->num_states);
+
+  if(drawing->table_file != NULL)
+  {
+    struct DFATable *table = freeze_dfa(min, symbol_bytes);
+
+    if(table == NULL || !write_dfa_table(table, drawing->table_file))
+      fprintf(log, "can't write a table to %s\n", drawing->table_file);
+    else if(verbose)
+      fprintf(log, "%s: %u rows of %u columns\n", drawing->table_file,
+          table->num_states, table->num_classes);
+
+    if(table != NULL)
+      delete_dfa_table(table);
+  }
+
+  for(i = 0; i < min->num_states; i++)
+  {
+    struct State *state = min->states[i];
+
+    /* Room for "s", i, and ":" or "," and a number for each pattern */
+    s = (char *) arena_alloc(arena, 16 * (state->num_patterns + 1));
+    temp = sprintf(s, "s%i", i);
+
+    for(j = 0; j < state->num_patterns; j++)
+      temp += sprintf(s + temp, "%c%i", j ? ',' : ':', state->patterns[j]);
+
+    state->id = s;
+  }
+
+  fprint_fsm(file, min, symbol_string, id_string);
+
+  fclose(file);
+
+  if(show_stats)
+    fprint_stats(log, name, &thread_stats, arena);
+}
+
+/* Say how much simplify_fsm() took out of a regexp's NFA */
+void report_simplified(FILE *log, char *name, struct SimplifyReport *report)
+{
+  fprintf(log, "%s: %i NFA states and %i transitions, %i and %i simplified "
+      "(%i in epsilon chains, %i dead)\n", name, report->states_before,
+      report->transitions_before, report->states_after,
+      report->transitions_after, report->states_collapsed,
+      report->states_pruned);
+}
+
+/* Draw the regexp numbered index + 1 of a batch on one thread, and then
+ *  free it
+ */
+void write_batch_item(void *item, int index, FILE *out)
+{
+  struct Drawing *drawing = (struct Drawing *) item;
+  struct Arena *its_arena = (drawing->cached != NULL) ?
+    drawing->cached->arena : drawing->nfa->arena;
+  char name[16];
+
+  sprintf(name, "%i.dot", index + 1);
+  write_automata(drawing, name, 1, out);
+
+  free(drawing->cache_key);
+  delete_arena(its_arena);
+}
+
+/* Read the regexps a line at a time, and only parse (and compile) the ones
+ *  the cache doesn't have a DFA for
+ */
+int read_with_cache(void)
+{
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  int result = 0;
+
+  while(result == 0 && (length = getline(&line, &capacity, stdin)) > 0)
+  {
+    /* The parser wants every regexp to end in a newline */
+    if(line[length - 1] != '\n')
+    {
+      line = (char *) realloc(line, length + 2);
+      strcpy(line + length++, "\n");
+    }
+
+    start_regexp();
+
+    char *key = cache_key_for(line);
+    struct FSM *cached = compile_cache_load(cache, key, arena, symbol_table);
+
+    if(cached != NULL)
+    {
+      struct Drawing drawing = { .cached = cached,
+        .alphabet_size = alphabet_size };
+
+      STATS_STOP(STATS_PARSE);
+      drawing.stats = thread_stats;
+
+      free(key);
+      input_number++;
+      draw_regexp(&drawing);
+    }
+    else
+    {
+      /* The parser picks the key up with the regexp */
+      cache_key = key;
+
+      yyin = fmemopen(line, length, "r");
+      yyrestart(yyin);
+      result = yyparse();
+      fclose(yyin);
+
+      free(cache_key);
+      cache_key = NULL;
+    }
+  }
+
+  free(line);
+
+  return result;
+}
+
+/* What a regexp's DFA is cached under: the regexp, an atom at a time, then
+ *  the alphabet it gets compiled over, which changes the DFA (and how it's
+ *  numbered), as does which NFA it's made from. Each atom is written as how
+ *  many ranges it's on and their names, so that blanks in a class count
+ *  and different ways of writing the same one don't. Its symbols get
+ *  interned, in the same order lexing and then cutting up its ranges would,
+ *  so that the alphabet is all there.
+ * The -L and -M budget goes in too. Only DFAs that kept to it get cached,
+ *  so under another budget, one that didn't keep to it would be drawn.
+ */
+char *cache_key_for(char *line)
+{
+  struct ByteRange ranges[MAX_BYTE_RANGES];
+  void **symbols = NULL;
+  size_t length = 0, size;
+  char *cur;
+  int i, j, num_ranges, atom_length, num_symbols = 0;
+
+  /* An atom is never written longer than its range names, which never take
+   *  more than two of them (".") to a character of the regexp
+   */
+  char *atoms = (char *) malloc( strlen(line) *
+      (2 * BYTE_RANGE_NAME_SIZE + 8) + 1 );
+  size_t atoms_length = 0;
+
+  for(cur = line; *cur; cur += atom_length)
+  {
+    num_ranges = parse_atom(cur, &atom_length, ranges);
+
+    /* Anything else but the blanks the lexer skips is written as it is */
+    if(num_ranges < 0)
+    {
+      atom_length = 1;
+
+      if(*cur != ' ' && *cur != '\t' && *cur != '\n')
+        atoms_length += sprintf(atoms + atoms_length, "%c ", *cur);
+
+      continue;
+    }
+
+    symbols = (void **) realloc(symbols,
+        (num_symbols + num_ranges) * sizeof(void *));
+
+    atoms_length += sprintf(atoms + atoms_length, "%i ", num_ranges);
+
+    for(j = 0; j < num_ranges; j++)
+    {
+      symbols[num_symbols] = alphabet_range(ranges[j].low, ranges[j].high);
+      atoms_length += sprintf(atoms + atoms_length, "%s ",
+          symbol_name(symbol_table, symbols[num_symbols++]));
+    }
+  }
+
+  if(num_symbols > 0)
+    intern_pieces(symbol_table, symbols, num_symbols, &alphabet,
+        &alphabet_size);
+  free(symbols);
+
+  size = atoms_length + 96;
+  for(i = 0; i < alphabet_size; i++)
+    size += strlen(symbol_name(symbol_table, alphabet[i])) + 1;
+
+  char *key = (char *) malloc( size );
+
+  length = sprintf(key, "%s\nat most %i states and %lu bytes\n",
+      glushkov ? "minimal dfa, glushkov" : "minimal dfa", max_dfa_states,
+      (unsigned long) max_dfa_bytes);
+
+  memcpy(key + length, atoms, atoms_length);
+  length += atoms_length;
+  free(atoms);
+
+  key[length++] = '\n';
+
+  for(i = 0; i < alphabet_size; i++)
+    length += sprintf(key + length, "%s ",
+        symbol_name(symbol_table, alphabet[i]));
+
+  key[length] = '\0';
+
+  return key;
+}
+
+/* Write out every line of the input files (stdin if there are none) that
+ *  has a match for the regexp somewhere in it
+ */
+void scan_inputs(struct FSM *fsm)
+{
+  struct MatchStream *stream = new_match_stream(fsm, alphabet, alphabet_size,
+      symbol_bytes, lazy_dfa_bytes, 1);
+  int i;
+
+  STATS_START(STATS_MATCH);
+
+  if(verbose && stream->literal_length > 0)
+    fprintf(stderr, "Skipping to lines with \"%.*s\" in\n",
+        stream->literal_length, stream->literal);
+
+  if(num_input_files == 0)
+    lines_matched += scan_file(stream, "-", stdout, NULL);
+
+  for(i = 0; i < num_input_files; i++)
+  {
+    long matches = scan_file(stream, input_files[i], stdout,
+        (num_input_files > 1) ? input_files[i] : NULL);
+
+    if(matches < 0)
+      perror(input_files[i]);
+    else
+      lines_matched += matches;
+  }
+
+  if(verbose)
+    fprintf(stderr, "%i lines matched, lazy DFA has %i states after %i "
+        "flushes\n", lines_matched, stream->lazy->num_states,
+        stream->lazy->num_flushes);
+
+  delete_match_stream(stream);
+
+  STATS_STOP(STATS_MATCH);
+}
+
+/* Write out every line of the input files (stdin if there are none) that
+ *  a table accepts all of, and the patterns it's accepted for, if there are
+ *  any. Returns nonzero if a file couldn't be read.
+ */
+int match_table_inputs(struct DFATable *table)
+{
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  int i, j, failed = 0;
+
+  for(i = 0; i < num_input_files || (i == 0 && num_input_files == 0); i++)
+  {
+    const char *label = (num_input_files > 1) ? input_files[i] : NULL;
+    FILE *file = (num_input_files == 0) ? stdin : fopen(input_files[i], "r");
+
+    if(file == NULL)
+    {
+      perror(input_files[i]);
+      failed = 1;
+      continue;
+    }
+
+    while((length = getline(&line, &capacity, file)) > 0)
+    {
+      if(line[length - 1] == '\n')
+        line[--length] = '\0';
+
+      uint32_t state = dfa_table_run(table, line, length);
+      const int *patterns;
+      int num_patterns;
+
+      if(!dfa_table_accepting(table, state))
+        continue;
+
+      if(label != NULL)
+        printf("%s:", label);
+
+      num_patterns = dfa_table_patterns(table, state, &patterns);
+
+      for(j = 0; j < num_patterns; j++)
+        printf("%i%c", patterns[j], (j == num_patterns - 1) ? ':' : ',');
+
+      printf("%s\n", line);
+      lines_matched++;
+    }
+
+    if(file != stdin)
+      fclose(file);
+  }
+
+  free(line);
+
+  return failed;
+}
+
+/* Write out every line of the input files (stdin if there are none) that
+ *  the regexp matches all of
+ */
+void test_lines(struct FSM *fsm)
+{
+  /* Bit-parallel if the pattern is small enough, otherwise a DFA that only
+   *  gets built as far as the lines take it
+   */
+  struct Matcher *matcher = new_matcher(fsm, alphabet, alphabet_size,
+      symbol_bytes, lazy_dfa_bytes);
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  int i;
+
+  STATS_START(STATS_MATCH);
+
+  for(i = 0; i < num_input_files || (i == 0 && num_input_files == 0); i++)
+  {
+    const char *label = (num_input_files > 1) ? input_files[i] : NULL;
+    FILE *file = (num_input_files == 0) ? stdin : fopen(input_files[i], "r");
+
+    if(file == NULL)
+    {
+      perror(input_files[i]);
+      continue;
+    }
+
+    while((length = getline(&line, &capacity, file)) > 0)
+    {
+      if(line[length - 1] == '\n')
+        line[--length] = '\0';
+
+      if(!matcher_match(matcher, line, length))
+        continue;
+
+      if(label != NULL)
+        printf("%s:", label);
+
+      printf("%s\n", line);
+      lines_matched++;
+    }
+
+    if(file != stdin)
+      fclose(file);
+  }
+
+  if(verbose)
+    fprintf(stderr, "%i lines matched all through, %s\n", lines_matched,
+        (matcher->engine == MATCHER_BIT_PARALLEL) ? "bit-parallel" :
+        "with a lazy DFA");
+
+  free(line);
+  delete_matcher(matcher);
+
+  STATS_STOP(STATS_MATCH);
+}
+
+int symbol_bytes(void *value, int *low, int *high)
+{
+  return parse_byte_range_name(symbol_name(symbol_table, value), low, high);
+}
+
+char *symbol_string(void *value)
+{
+  return range_label(symbol_table, value);
 }
 
 char *meta_id_string(void *id)
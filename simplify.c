@@ -0,0 +1,375 @@
+/*
+ * simplify.c | Taking epsilon chains, dead states and repeated transitions
+ *  out of NFAs
+ *
+ * Thompson's construction strings states together with epsilon transitions,
+ *  so a lot of them do nothing but pass straight on to the next one. Each
+ *  of those is worth one state and one transition less, for everything that
+ *  goes on to close over, determinize or draw the NFA.
+ * Chains get followed to their ends first, and every transition is sent to
+ *  where its chain ends. Then what's left is searched forward from the start
+ *  and backward from the accepting states, and only states found both ways
+ *  are kept.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "simplify.h"
+#include "stats.h"
+
+extern void *EPSILON;
+
+static int only_epsilon(struct State *state);
+static void resolve_chains(int *forward, int *resolved, int n);
+static int count_targets(struct Transition *root);
+static void collect_targets(struct Transition *root, int from, int *resolved,
+    int **targets, int *num_targets, int *capacity);
+static int rewrite_transitions(struct Transition *root, int from,
+    struct FSM *nfa, int *resolved, int *kept, int *seen, int *stamp);
+static void remove_empty_transitions(struct Arena *arena,
+    struct Transition **node);
+
+void simplify_fsm(struct FSM *nfa, struct SimplifyReport *report)
+{
+  int n = nfa->num_states, i, j, head, tail;
+  int transitions_before = 0, transitions_after = 0;
+  int collapsed = 0, pruned = 0, count = 0;
+
+  STATS_START(STATS_CONSTRUCT);
+
+  for(i = 0; i < n; i++)
+    nfa->states[i]->index = i;
+
+  /* Where each state's epsilon chain ends, if it's on one */
+  int *forward = (int *) malloc( n * sizeof(int) );
+  int *resolved = (int *) malloc( n * sizeof(int) );
+
+  for(i = 0; i < n; i++)
+  {
+    struct State *state = nfa->states[i];
+
+    if(state->transitions_tree != NULL)
+      transitions_before += count_targets(state->transitions_tree);
+
+    forward[i] = only_epsilon(state) ?
+      state->transitions_tree->to[0]->index : i;
+  }
+
+  resolve_chains(forward, resolved, n);
+
+  int start = resolved[nfa->start_state->index];
+
+  /* What's left once chains are collapsed, packed together: the states i
+   *  goes to are targets[edge_start[i]] up to targets[edge_start[i + 1]]
+   */
+  int *edge_start = (int *) malloc( (n + 1) * sizeof(int) );
+  int *targets = NULL, num_targets = 0, capacity = 0;
+
+  for(i = 0; i < n; i++)
+  {
+    edge_start[i] = num_targets;
+
+    if(resolved[i] == i && nfa->states[i]->transitions_tree != NULL)
+      collect_targets(nfa->states[i]->transitions_tree, i, resolved,
+          &targets, &num_targets, &capacity);
+  }
+
+  edge_start[n] = num_targets;
+
+  /* Everything that can be got to from the start */
+  int *reached = (int *) calloc( n, sizeof(int) );
+  int *queue = (int *) malloc( n * sizeof(int) );
+
+  head = tail = 0;
+  reached[start] = 1;
+  queue[tail++] = start;
+
+  while(head < tail)
+  {
+    i = queue[head++];
+
+    for(j = edge_start[i]; j < edge_start[i + 1]; j++)
+      if(!reached[targets[j]])
+      {
+        reached[targets[j]] = 1;
+        queue[tail++] = targets[j];
+      }
+  }
+
+  /* Of those, everything that can get to an accepting state, going
+   *  backwards along the same transitions
+   */
+  int *reverse_start = (int *) calloc( n + 1, sizeof(int) );
+  int *reverse = (int *) malloc( (num_targets + 1) * sizeof(int) );
+  int *next_reverse = (int *) malloc( (n + 1) * sizeof(int) );
+
+  for(i = 0; i < n; i++)
+    if(reached[i])
+      for(j = edge_start[i]; j < edge_start[i + 1]; j++)
+        reverse_start[targets[j] + 1]++;
+
+  for(i = 0; i < n; i++)
+    reverse_start[i + 1] += reverse_start[i];
+
+  memcpy(next_reverse, reverse_start, (n + 1) * sizeof(int));
+
+  for(i = 0; i < n; i++)
+    if(reached[i])
+      for(j = edge_start[i]; j < edge_start[i + 1]; j++)
+        reverse[next_reverse[targets[j]]++] = i;
+
+  int *kept = (int *) calloc( n, sizeof(int) );
+
+  head = tail = 0;
+
+  for(i = 0; i < n; i++)
+    if(reached[i] && nfa->states[i]->accepting)
+    {
+      kept[i] = 1;
+      queue[tail++] = i;
+    }
+
+  while(head < tail)
+  {
+    i = queue[head++];
+
+    for(j = reverse_start[i]; j < reverse_start[i + 1]; j++)
+      if(!kept[reverse[j]])
+      {
+        kept[reverse[j]] = 1;
+        queue[tail++] = reverse[j];
+      }
+  }
+
+  /* Even if it can't accept anything, it has to start somewhere */
+  kept[start] = 1;
+
+  /* Send the transitions of the states being kept where they're going now,
+   *  before any of their indexes change
+   */
+  int *seen = (int *) calloc( n, sizeof(int) ), stamp = 0;
+
+  for(i = 0; i < n; i++)
+    if(kept[i] && nfa->states[i]->transitions_tree != NULL)
+    {
+      struct State *state = nfa->states[i];
+
+      transitions_after += rewrite_transitions(state->transitions_tree, i,
+          nfa, resolved, kept, seen, &stamp);
+      remove_empty_transitions(state->arena, &state->transitions_tree);
+    }
+
+  /* Then close the gaps up */
+  struct State *start_state = nfa->states[start];
+
+  for(i = 0; i < n; i++)
+  {
+    struct State *state = nfa->states[i];
+
+    if(kept[i])
+    {
+      nfa->states[count] = state;
+      state->index = count++;
+    }
+    else
+    {
+      if(resolved[i] != i)
+        collapsed++;
+      else
+        pruned++;
+
+      delete_state(state);
+    }
+  }
+
+  nfa->num_states = count;
+  nfa->start_state = start_state;
+
+  /* Transitions were changed behind add_transition()'s back */
+  if(nfa->keeps_predecessors)
+    index_predecessors(nfa);
+
+  if(report != NULL)
+  {
+    report->states_before = n;
+    report->states_after = count;
+    report->transitions_before = transitions_before;
+    report->transitions_after = transitions_after;
+    report->states_collapsed = collapsed;
+    report->states_pruned = pruned;
+  }
+
+  free(forward);
+  free(resolved);
+  free(edge_start);
+  free(targets);
+  free(reached);
+  free(queue);
+  free(reverse_start);
+  free(reverse);
+  free(next_reverse);
+  free(kept);
+  free(seen);
+
+  STATS_STOP(STATS_CONSTRUCT);
+}
+
+/* Is a state just a link in an epsilon chain: not accepting, and with only
+ *  an epsilon transition to one other state?
+ */
+static int only_epsilon(struct State *state)
+{
+  struct Transition *t = state->transitions_tree;
+
+  return !state->accepting && t != NULL && t->left == NULL &&
+    t->right == NULL && t->value == EPSILON && t->num_to == 1 &&
+    t->to[0] != state;
+}
+
+/* Follow every chain to its end, so that resolved[i] is where state i's
+ *  transitions really go. A chain that goes round in a circle ends where
+ *  it was first found to; that state's epsilon transition then goes to
+ *  itself, and it goes nowhere else, so it gets pruned.
+ */
+static void resolve_chains(int *forward, int *resolved, int n)
+{
+  int *walked = (int *) malloc( n * sizeof(int) );
+  int *path = (int *) malloc( n * sizeof(int) );
+  int i, j, k, length, end;
+
+  for(i = 0; i < n; i++)
+  {
+    resolved[i] = -1;
+    walked[i] = -1;
+  }
+
+  for(i = 0; i < n; i++)
+  {
+    if(resolved[i] >= 0)
+      continue;
+
+    length = 0;
+
+    for(j = i; resolved[j] < 0 && forward[j] != j && walked[j] != i;
+        j = forward[j])
+    {
+      walked[j] = i;
+      path[length++] = j;
+    }
+
+    if(resolved[j] >= 0)
+      end = resolved[j];
+    else
+      end = resolved[j] = j;
+
+    for(k = 0; k < length; k++)
+      resolved[path[k]] = end;
+  }
+
+  free(walked);
+  free(path);
+}
+
+static int count_targets(struct Transition *root)
+{
+  int count = root->num_to;
+
+  if(root->left != NULL)
+    count += count_targets(root->left);
+
+  if(root->right != NULL)
+    count += count_targets(root->right);
+
+  return count;
+}
+
+/* Where a state's transitions go once chains are collapsed, leaving out
+ *  epsilon transitions to itself
+ */
+static void collect_targets(struct Transition *root, int from, int *resolved,
+    int **targets, int *num_targets, int *capacity)
+{
+  int i;
+
+  if(root->left != NULL)
+    collect_targets(root->left, from, resolved, targets, num_targets,
+        capacity);
+
+  for(i = 0; i < root->num_to; i++)
+  {
+    int to = resolved[root->to[i]->index];
+
+    if(root->value == EPSILON && to == from)
+      continue;
+
+    if(*num_targets == *capacity)
+    {
+      *capacity = *capacity ? 2 * *capacity : 64;
+      *targets = (int *) realloc(*targets, *capacity * sizeof(int));
+    }
+
+    (*targets)[(*num_targets)++] = to;
+  }
+
+  if(root->right != NULL)
+    collect_targets(root->right, from, resolved, targets, num_targets,
+        capacity);
+}
+
+/* Point every transition in a tree at the end of its chain, dropping those
+ *  that go to states that aren't being kept, epsilon transitions back to
+ *  the same state, and repeats. Returns how many are left.
+ */
+static int rewrite_transitions(struct Transition *root, int from,
+    struct FSM *nfa, int *resolved, int *kept, int *seen, int *stamp)
+{
+  int i, count = 0, left = 0;
+
+  if(root->left != NULL)
+    left += rewrite_transitions(root->left, from, nfa, resolved, kept, seen,
+        stamp);
+
+  /* Every node gets a new stamp, so seen[] never needs clearing */
+  ++*stamp;
+
+  for(i = 0; i < root->num_to; i++)
+  {
+    int to = resolved[root->to[i]->index];
+
+    if(!kept[to] || (root->value == EPSILON && to == from) ||
+        seen[to] == *stamp)
+      continue;
+
+    seen[to] = *stamp;
+    root->to[count++] = nfa->states[to];
+  }
+
+  root->num_to = count;
+
+  if(root->right != NULL)
+    left += rewrite_transitions(root->right, from, nfa, resolved, kept, seen,
+        stamp);
+
+  return left + count;
+}
+
+/* Take out every node of a tree that no longer goes anywhere. Children go
+ *  first, so whatever takes a node's place has already been kept.
+ */
+static void remove_empty_transitions(struct Arena *arena,
+    struct Transition **node)
+{
+  if((*node)->left != NULL)
+    remove_empty_transitions(arena, &(*node)->left);
+
+  if((*node)->right != NULL)
+    remove_empty_transitions(arena, &(*node)->right);
+
+  if((*node)->num_to == 0)
+  {
+    arena_free(arena, (*node)->to);
+    delete_struct_transition(arena, node);
+  }
+}
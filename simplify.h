@@ -0,0 +1,37 @@
+/* Headers for simplifying NFAs before anything's done with them
+ */
+
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+/* How much simplify_fsm() took out of an NFA. Transitions are counted by
+ *  target, so a transition to two states counts as two.
+ */
+struct SimplifyReport
+{
+  int states_before;
+  int states_after;
+  int transitions_before;
+  int transitions_after;
+
+  int states_collapsed;    /* Epsilon chain links, merged into the next */
+  int states_pruned;       /* Unreachable, or going nowhere that accepts */
+};
+
+/*
+ * Make an NFA smaller without changing what it accepts (or, for accepting
+ *  states, which patterns for), in place:
+ *  - a state that doesn't accept and only has an epsilon transition to one
+ *     other state is replaced by that state, all along a chain of them;
+ *  - states that can't be got to from the start state, or can't get to an
+ *     accepting state, are taken out along with transitions to them;
+ *  - epsilon transitions from a state to itself, and any transition that's
+ *     there twice, are taken out.
+ * Every transition has to go to a state of the NFA. What's left keeps its
+ *  order, and the states' indexes are set to match. States taken out are
+ *  freed if they're on the heap. If it keeps predecessors, they're rebuilt.
+ * If report isn't NULL, it says how much smaller the NFA got.
+ */
+void simplify_fsm(struct FSM *nfa, struct SimplifyReport *report);
+
+#endif
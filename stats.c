@@ -0,0 +1,90 @@
+/*
+ * stats.c | Counting and timing what goes into compiling a regexp
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "arena.h"
+#include "stats.h"
+
+_Thread_local struct Stats thread_stats;
+
+static const char *phase_names[STATS_NUM_PHASES] =
+{
+  "parse", "construct", "closure", "determinize", "minimize", "emit", "match"
+};
+
+int stats_enabled(void)
+{
+#ifdef NO_STATS
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+double stats_clock(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void reset_stats(struct Stats *stats)
+{
+  memset(stats, 0, sizeof(struct Stats));
+}
+
+void add_stats(struct Stats *into, const struct Stats *from)
+{
+  int i;
+
+  into->states_created += from->states_created;
+  into->transitions_created += from->transitions_created;
+  into->closure_steps += from->closure_steps;
+  into->metastate_comparisons += from->metastate_comparisons;
+  into->reallocs += from->reallocs;
+
+  for(i = 0; i < STATS_NUM_PHASES; i++)
+    into->seconds[i] += from->seconds[i];
+}
+
+void fprint_stats(FILE *stream, const char *name, struct Stats *stats,
+    struct Arena *arena)
+{
+  struct rusage usage;
+  const char *cur;
+  int i;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  /* The name could be a regexp, with anything in it */
+  fprintf(stream, "{\"name\":\"");
+
+  for(cur = name; *cur; cur++)
+    if(*cur == '"' || *cur == '\\')
+      fprintf(stream, "\\%c", *cur);
+    else if((unsigned char) *cur < ' ')
+      fprintf(stream, "\\u%04x", (unsigned char) *cur);
+    else
+      putc(*cur, stream);
+
+  fprintf(stream, "\",\"seconds\":{");
+
+  for(i = 0; i < STATS_NUM_PHASES; i++)
+    fprintf(stream, "%s\"%s\":%.6f", i ? "," : "", phase_names[i],
+        stats->seconds[i]);
+
+  fprintf(stream, "},\"states_created\":%ld,\"transitions_created\":%ld,"
+      "\"closure_steps\":%ld,\"metastate_comparisons\":%ld,"
+      "\"reallocs\":%ld,\"arena_bytes\":%lu,\"peak_rss_kb\":%ld}\n",
+      stats->states_created, stats->transitions_created,
+      stats->closure_steps, stats->metastate_comparisons, stats->reallocs,
+      (unsigned long) ((arena != NULL) ? arena->bytes_used : 0),
+      (long) usage.ru_maxrss);
+}
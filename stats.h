@@ -0,0 +1,74 @@
+/* Headers for counting and timing what goes into compiling a regexp
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+
+/* The phases a regexp goes through, each timed on its own */
+#define STATS_PARSE 0          /* Reading it, building the NFA included */
+#define STATS_CONSTRUCT 1      /* fsmunion() and so on, and simplify_fsm() */
+#define STATS_CLOSURE 2        /* Working out the epsilon closures */
+#define STATS_DETERMINIZE 3    /* Subset construction, closures included */
+#define STATS_MINIMIZE 4
+#define STATS_EMIT 5           /* Writing the .dot file */
+#define STATS_MATCH 6          /* Going through input files */
+#define STATS_NUM_PHASES 7
+
+/*
+ * What the library has done since the stats were last reset. Every thread
+ *  counts into its own, so counting costs no more than adding one, and
+ *  nothing has to be locked; whoever starts threads adds theirs in once
+ *  they're done (see add_stats()).
+ *
+ * Build with -DNO_STATS and the counting and timing all compile to nothing.
+ */
+struct Stats
+{
+  long states_created;
+  long transitions_created;      /* Edges, whatever tree node they're in */
+  long closure_steps;            /* Epsilon edges followed, closures ORed */
+  long metastate_comparisons;    /* Sets of states compared in lookups */
+  long reallocs;                 /* Arrays grown one element at a time */
+
+  double seconds[STATS_NUM_PHASES];
+  double started[STATS_NUM_PHASES];
+};
+
+extern _Thread_local struct Stats thread_stats;
+
+#ifdef NO_STATS
+#define STATS_COUNT(counter) ((void) 0)
+#define STATS_ADD(counter, n) ((void) 0)
+#define STATS_START(phase) ((void) 0)
+#define STATS_STOP(phase) ((void) 0)
+#else
+#define STATS_COUNT(counter) ((void) thread_stats.counter++)
+#define STATS_ADD(counter, n) ((void) (thread_stats.counter += (n)))
+#define STATS_START(phase) \
+  ((void) (thread_stats.started[phase] = stats_clock()))
+#define STATS_STOP(phase) \
+  ((void) (thread_stats.seconds[phase] += \
+           stats_clock() - thread_stats.started[phase]))
+#endif
+
+/* Are the stats compiled in at all? */
+int stats_enabled(void);
+
+/* Seconds since some fixed point */
+double stats_clock(void);
+
+void reset_stats(struct Stats *stats);
+
+/* Add one thread's counts and times into another's */
+void add_stats(struct Stats *into, const struct Stats *from);
+
+/* Write stats out as one line of JSON, under a name, with how much an
+ *  arena (if it isn't NULL) has handed out and the most memory the process
+ *  has had so far
+ */
+void fprint_stats(FILE *stream, const char *name, struct Stats *stats,
+    struct Arena *arena);
+
+#endif
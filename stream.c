@@ -0,0 +1,381 @@
+/*
+ * stream.c | Matching input that arrives a piece at a time
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fsm.h"
+#include "dfsm.h"
+#include "lazy_dfa.h"
+#include "literal.h"
+#include "stream.h"
+
+static long scan_lines(struct MatchStream *stream, const char *buffer,
+    size_t length, FILE *out, const char *label);
+static long scan_mapped(struct MatchStream *stream, int fd, size_t size,
+    FILE *out, const char *label);
+static long scan_chunked(struct MatchStream *stream, int fd, FILE *out,
+    const char *label);
+static void write_line(struct MatchStream *stream, FILE *out,
+    const char *label, const char *line, size_t length);
+static void note_patterns(struct MatchStream *stream, struct LazyState *state);
+
+#define PATTERN_BITS (8 * sizeof(unsigned long))
+
+struct MatchStream *new_match_stream(struct FSM *nfa, void **alphabet,
+    int num_symbols, symbol_bytes_func symbol_bytes, size_t memory_budget,
+    int unanchored)
+{
+  struct MatchStream *stream = (struct MatchStream *)
+    malloc( sizeof(struct MatchStream) );
+
+  stream->lazy = new_lazy_dfa(nfa, alphabet, num_symbols, symbol_bytes,
+      memory_budget);
+  stream->lazy->unanchored = unanchored;
+  stream->unanchored = unanchored;
+
+  /* Make room for every pattern id there is, if there are any */
+  int i, j, max_pattern = -1;
+
+  for(i = 0; i < nfa->num_states; i++)
+    for(j = 0; j < nfa->states[i]->num_patterns; j++)
+      if(nfa->states[i]->patterns[j] > max_pattern)
+        max_pattern = nfa->states[i]->patterns[j];
+
+  stream->num_pattern_words = (max_pattern + PATTERN_BITS) / PATTERN_BITS;
+  stream->patterns = (max_pattern < 0) ? NULL : (unsigned long *)
+    malloc( stream->num_pattern_words * sizeof(unsigned long) );
+
+  stream->literal_length = required_literal(nfa, symbol_bytes,
+      stream->literal, STREAM_LITERAL_MAX);
+
+  match_stream_reset(stream);
+
+  return stream;
+}
+
+void delete_match_stream(struct MatchStream *stream)
+{
+  delete_lazy_dfa(stream->lazy);
+  free(stream->patterns);
+  free(stream);
+}
+
+void match_stream_reset(struct MatchStream *stream)
+{
+  stream->state = lazy_dfa_start(stream->lazy);
+  stream->matched = stream->state->accepting;
+
+  if(stream->patterns != NULL)
+  {
+    memset(stream->patterns, 0,
+        stream->num_pattern_words * sizeof(unsigned long));
+    note_patterns(stream, stream->state);
+  }
+}
+
+int match_stream_feed(struct MatchStream *stream, const char *buffer,
+    size_t length)
+{
+  const unsigned char *cur = (const unsigned char *) buffer;
+  const unsigned char *end = cur + length;
+  struct LazyState *state = stream->state;
+  const int *classes = stream->lazy->classes;
+
+  /* Unanchored, nothing after a match can undo it. With patterns, though,
+   *  more of them could still match.
+   */
+  int stop_at_match = stream->unanchored && stream->patterns == NULL;
+
+  if(stop_at_match && stream->matched)
+    return 1;
+
+  while(cur < end && !state->dead)
+  {
+    struct LazyState *next = state->next[classes[*cur]];
+
+    if(next == NULL)
+      next = lazy_dfa_step(stream->lazy, state, *cur);
+
+    state = next;
+    cur++;
+
+    if(state->accepting)
+    {
+      if(stop_at_match)
+        break;
+
+      if(stream->unanchored)
+      {
+        stream->matched = 1;
+        note_patterns(stream, state);
+      }
+    }
+  }
+
+  stream->state = state;
+
+  if(!stream->unanchored)
+  {
+    /* Only where the input has got to counts */
+    stream->matched = state->accepting;
+
+    if(stream->patterns != NULL)
+    {
+      memset(stream->patterns, 0,
+          stream->num_pattern_words * sizeof(unsigned long));
+      note_patterns(stream, state);
+    }
+  }
+  else if(state->accepting)
+    stream->matched = 1;
+
+  return stream->matched;
+}
+
+int match_stream_next_pattern(struct MatchStream *stream, int after)
+{
+  int i = after + 1;
+
+  if(stream->patterns == NULL)
+    return -1;
+
+  while(i < stream->num_pattern_words * (int) PATTERN_BITS)
+  {
+    unsigned long word = stream->patterns[i / PATTERN_BITS] >>
+      (i % PATTERN_BITS);
+
+    if(word)
+      return i + __builtin_ctzl(word);
+
+    i = (i / PATTERN_BITS + 1) * PATTERN_BITS;
+  }
+
+  return -1;
+}
+
+static void note_patterns(struct MatchStream *stream, struct LazyState *state)
+{
+  int i;
+
+  for(i = 0; i < state->num_patterns; i++)
+    stream->patterns[state->patterns[i] / PATTERN_BITS] |=
+      1UL << (state->patterns[i] % PATTERN_BITS);
+}
+
+long scan_file(struct MatchStream *stream, const char *path, FILE *out,
+    const char *label)
+{
+  int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+  struct stat info;
+  long matches;
+
+  if(fd < 0)
+    return -1;
+
+  /* Only regular files can be mapped; an empty one can't even be that */
+  if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    matches = scan_mapped(stream, fd, info.st_size, out, label);
+  else
+    matches = scan_chunked(stream, fd, out, label);
+
+  if(fd != STDIN_FILENO)
+    close(fd);
+
+  return matches;
+}
+
+static long scan_mapped(struct MatchStream *stream, int fd, size_t size,
+    FILE *out, const char *label)
+{
+  char *map = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if(map == MAP_FAILED)
+    return scan_chunked(stream, fd, out, label);
+
+  /* We only go through it once, front to back */
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  long matches = scan_lines(stream, map, size, out, label);
+
+  munmap(map, size);
+
+  return matches;
+}
+
+/* Match every whole line in a buffer, plus whatever is after the last
+ *  newline, which is taken to be a line too.
+ */
+static long scan_lines(struct MatchStream *stream, const char *buffer,
+    size_t length, FILE *out, const char *label)
+{
+  const char *cur = buffer, *end = buffer + length;
+  long matches = 0;
+
+  if(stream->literal_length > 0)
+  {
+    /* Only lines with the literal in can match, so skip to the next one */
+    const char *hit;
+
+    while((hit = find_literal(cur, end - cur, stream->literal,
+            stream->literal_length)) != NULL)
+    {
+      const char *line_start = (const char *) memrchr(cur, '\n', hit - cur);
+      const char *newline = (const char *) memchr(hit, '\n', end - hit);
+      const char *line_end = (newline != NULL) ? newline : end;
+
+      line_start = (line_start != NULL) ? line_start + 1 : cur;
+
+      match_stream_reset(stream);
+
+      if(match_stream_feed(stream, line_start, line_end - line_start))
+      {
+        write_line(stream, out, label, line_start, line_end - line_start);
+        matches++;
+      }
+
+      if(line_end == end)
+        break;
+
+      cur = line_end + 1;
+    }
+
+    return matches;
+  }
+
+  while(cur < end)
+  {
+    const char *newline = (const char *) memchr(cur, '\n', end - cur);
+    const char *line_end = (newline != NULL) ? newline : end;
+
+    match_stream_reset(stream);
+
+    if(match_stream_feed(stream, cur, line_end - cur))
+    {
+      write_line(stream, out, label, cur, line_end - cur);
+      matches++;
+    }
+
+    cur = line_end + 1;
+  }
+
+  return matches;
+}
+
+static long scan_chunked(struct MatchStream *stream, int fd, FILE *out,
+    const char *label)
+{
+  size_t capacity = STREAM_CHUNK_SIZE, have = 0, fed = 0;
+  char *buffer = (char *) aligned_alloc(4096, capacity);
+  long matches = 0;
+  ssize_t got;
+
+  /* buffer[0] up to buffer[have] is the current line so far, then whatever
+   *  came in after it. The line has been fed up to buffer[fed]. Feeding
+   *  never goes back over anything, even when a line runs across chunks.
+   */
+  match_stream_reset(stream);
+
+  while((got = read(fd, buffer + have, capacity - have)) != 0)
+  {
+    if(got < 0)
+    {
+      free(buffer);
+      return -1;
+    }
+
+    have += got;
+
+    size_t line_start = 0;
+
+    for(;;)
+    {
+      char *newline = (char *) memchr(buffer + fed, '\n', have - fed);
+
+      if(newline == NULL)
+      {
+        match_stream_feed(stream, buffer + fed, have - fed);
+        fed = have;
+        break;
+      }
+
+      if(match_stream_feed(stream, buffer + fed, newline - (buffer + fed)))
+      {
+        write_line(stream, out, label, buffer + line_start,
+            newline - (buffer + line_start));
+        matches++;
+      }
+
+      match_stream_reset(stream);
+      fed = line_start = newline + 1 - buffer;
+
+      /* Every whole line after that one can go through the literal search */
+      char *last = (stream->literal_length > 0) ?
+        (char *) memrchr(buffer + fed, '\n', have - fed) : NULL;
+
+      if(last != NULL)
+      {
+        matches += scan_lines(stream, buffer + fed, last + 1 - (buffer + fed),
+            out, label);
+        match_stream_reset(stream);
+        fed = line_start = last + 1 - buffer;
+      }
+    }
+
+    /* Keep the unfinished line at the front, making room if it fills the
+     *  whole buffer
+     */
+    have -= line_start;
+    fed -= line_start;
+    memmove(buffer, buffer + line_start, have);
+
+    if(have == capacity)
+    {
+      char *bigger = (char *) aligned_alloc(4096, 2 * capacity);
+      memcpy(bigger, buffer, have);
+      free(buffer);
+      buffer = bigger;
+      capacity *= 2;
+    }
+  }
+
+  /* The last line, if it had no newline */
+  if(have > 0 && stream->matched)
+  {
+    write_line(stream, out, label, buffer, have);
+    matches++;
+  }
+
+  free(buffer);
+
+  return matches;
+}
+
+static void write_line(struct MatchStream *stream, FILE *out,
+    const char *label, const char *line, size_t length)
+{
+  if(label != NULL)
+    fprintf(out, "%s:", label);
+
+  if(stream->patterns != NULL)
+  {
+    int pattern = match_stream_next_pattern(stream, -1);
+
+    while(pattern >= 0)
+    {
+      fprintf(out, "%i", pattern);
+      pattern = match_stream_next_pattern(stream, pattern);
+      putc(pattern >= 0 ? ',' : ':', out);
+    }
+  }
+
+  fwrite(line, 1, length, out);
+  putc('\n', out);
+}
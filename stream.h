@@ -0,0 +1,83 @@
+/* Headers for matching input that arrives a piece at a time
+ */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* How much the scanner reads at once when it can't mmap() the input */
+#define STREAM_CHUNK_SIZE (1 << 20)
+
+/* The longest required literal the scanner looks for */
+#define STREAM_LITERAL_MAX 32
+
+/*
+ * Where matching has got to in some input, which can be fed in pieces of
+ *  any size: a match can start in one piece and finish in a later one.
+ *
+ * Anchored, the input matches if all of it (so far) is in the language.
+ *  Unanchored, it matches once any part of it is, and stays matched; that's
+ *  what grep does with each line.
+ *
+ * If the NFA's patterns are labelled (see label_fsm()), the stream also
+ *  keeps track of which of them match: anchored, the ones the input so far
+ *  matches all of; unanchored, every one that has matched anywhere. All of
+ *  them come out of the one pass over the input.
+ *
+ * The states come out of a lazy DFA that the stream has to itself, since
+ *  building a state can flush every state the DFA has.
+ */
+struct MatchStream
+{
+  struct LazyDFA *lazy;
+  struct LazyState *state;
+  int unanchored;
+  int matched;
+
+  /* Bitset of the patterns matched, or NULL if they aren't labelled */
+  unsigned long *patterns;
+  int num_pattern_words;
+
+  /* Something every match has in it (see required_literal()), so lines
+   *  without it can be skipped without matching. None if literal_length is 0.
+   */
+  char literal[STREAM_LITERAL_MAX];
+  int literal_length;
+};
+
+struct MatchStream *new_match_stream(struct FSM *nfa, void **alphabet,
+    int num_symbols, symbol_bytes_func symbol_bytes, size_t memory_budget,
+    int unanchored);
+void delete_match_stream(struct MatchStream *stream);
+
+/* Start again on new input */
+void match_stream_reset(struct MatchStream *stream);
+
+/* Carry on with the next piece of input. Returns whether the input matches
+ *  so far.
+ */
+int match_stream_feed(struct MatchStream *stream, const char *buffer,
+    size_t length);
+
+/* The first pattern matched that's numbered after the one given, or -1 if
+ *  there are no more. Start from -1 to go through all of them.
+ */
+int match_stream_next_pattern(struct MatchStream *stream, int after);
+
+/* Go through a file a line at a time, like grep, writing the lines that
+ *  match to out (after label and a colon, unless label is NULL, and then the
+ *  patterns that matched and a colon, if they're labelled). A path of "-"
+ *  means stdin.
+ * Regular files are mmap()ed and the lines written straight out of the
+ *  mapping. Anything else, like a pipe, is read in big chunks, and only the
+ *  part of a line left over at the end of a chunk ever gets moved.
+ * If the stream has a literal, the scanner searches for that instead of
+ *  going through every line, and only matches the lines it turns up in.
+ * Returns how many lines matched, or -1 if the file couldn't be read.
+ */
+long scan_file(struct MatchStream *stream, const char *path, FILE *out,
+    const char *label);
+
+#endif
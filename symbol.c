@@ -0,0 +1,102 @@
+/*
+ * symbol.c | Interning symbol names as small integers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbol.h"
+
+static unsigned long hash_name(const char *name);
+
+struct SymbolTable *new_symbol_table(void)
+{
+  struct SymbolTable *table = (struct SymbolTable *)
+    malloc( sizeof(struct SymbolTable) );
+
+  table->capacity = 16;
+  table->num_symbols = 1;
+  table->names = (char **) malloc( table->capacity * sizeof(char *) );
+  table->names[0] = NULL;
+
+  table->num_buckets = 32;
+  table->buckets = (int *) calloc( table->num_buckets, sizeof(int) );
+
+  return table;
+}
+
+void delete_symbol_table(struct SymbolTable *table)
+{
+  int i;
+
+  for(i = 1; i < table->num_symbols; i++)
+    free(table->names[i]);
+
+  free(table->names);
+  free(table->buckets);
+  free(table);
+}
+
+void *intern_symbol(struct SymbolTable *table, const char *name)
+{
+  unsigned long mask = table->num_buckets - 1;
+  unsigned long i = hash_name(name) & mask;
+
+  while(table->buckets[i] != 0)
+  {
+    if(strcmp(table->names[table->buckets[i]], name) == 0)
+      return ID_SYMBOL(table->buckets[i]);
+
+    i = (i + 1) & mask;
+  }
+
+  /* It's new */
+  if(table->num_symbols == table->capacity)
+  {
+    table->capacity *= 2;
+    table->names = (char **) realloc(table->names,
+        table->capacity * sizeof(char *));
+  }
+
+  int id = table->num_symbols++;
+  table->names[id] = strdup(name);
+
+  /* Keep the table at most half full */
+  if(2 * table->num_symbols > table->num_buckets)
+  {
+    int j;
+
+    free(table->buckets);
+    table->num_buckets *= 2;
+    table->buckets = (int *) calloc( table->num_buckets, sizeof(int) );
+    mask = table->num_buckets - 1;
+
+    for(j = 1; j < table->num_symbols; j++)
+    {
+      i = hash_name(table->names[j]) & mask;
+      while(table->buckets[i] != 0)
+        i = (i + 1) & mask;
+      table->buckets[i] = j;
+    }
+  }
+  else
+    table->buckets[i] = id;
+
+  return ID_SYMBOL(id);
+}
+
+const char *symbol_name(struct SymbolTable *table, void *symbol)
+{
+  return table->names[SYMBOL_ID(symbol)];
+}
+
+/* FNV-1a */
+static unsigned long hash_name(const char *name)
+{
+  unsigned long hash = 14695981039346656037UL;
+
+  while(*name)
+    hash = (hash ^ (unsigned char) *name++) * 1099511628211UL;
+
+  return hash;
+}
@@ -0,0 +1,46 @@
+/* Headers for interned transition symbols
+ */
+
+#ifndef __SYMBOL_H__
+#define __SYMBOL_H__
+
+#include <stdint.h>
+
+/*
+ * Transitions are labelled with a void *, and a symbol is a small integer
+ *  carried in one: 0 is EPSILON, and each name interned in a SymbolTable
+ *  gets the next number up. Two symbols are the same exactly when their
+ *  numbers are, so comparing them is just comparing the numbers, with no
+ *  strings (or function pointers) involved.
+ */
+#define SYMBOL_ID(symbol) ((int) (intptr_t) (symbol))
+#define ID_SYMBOL(id) ((void *) (intptr_t) (id))
+
+struct SymbolTable
+{
+  char **names;          /* Indexed by id; names[0] is NULL, for EPSILON */
+  int num_symbols;       /* Counting EPSILON */
+  int capacity;
+
+  int *buckets;          /* Ids hashed by name, 0 where there's none */
+  int num_buckets;
+};
+
+struct SymbolTable *new_symbol_table(void);
+void delete_symbol_table(struct SymbolTable *table);
+
+/* The symbol for a name, the same one every time for the same name */
+void *intern_symbol(struct SymbolTable *table, const char *name);
+
+/* The name a symbol was interned with, or NULL for EPSILON */
+const char *symbol_name(struct SymbolTable *table, void *symbol);
+
+/* Orders symbols by number, so EPSILON comes before all the rest */
+static inline int compare_symbols(void *left, void *right)
+{
+  uintptr_t l = (uintptr_t) left, r = (uintptr_t) right;
+
+  return (l > r) - (l < r);
+}
+
+#endif